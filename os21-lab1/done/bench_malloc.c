@@ -0,0 +1,793 @@
+/**
+ * @file bench_malloc.c
+ * @brief Micro-benchmarks for the custom allocators
+ *
+ * Every benchmark is a subcommand; run without arguments to run them all.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "malloc.h"
+
+void *(*l1_malloc)(size_t) = libc_malloc;
+l1_error (*l1_free)(void *) = libc_free;
+void (*l1_init)(void) = NULL;
+void (*l1_deinit)(void) = NULL;
+void *(*l1_realloc)(void *, size_t) = libc_realloc;
+void *(*l1_calloc)(size_t, size_t) = libc_calloc;
+void *(*l1_memalign)(size_t, size_t) = libc_memalign;
+
+#define BENCH_ITERS 200000
+
+static void use_chunk_allocator(void) {
+  l1_init = l1_chunk_init;
+  l1_deinit = l1_chunk_deinit;
+  l1_malloc = l1_chunk_malloc;
+  l1_free = l1_chunk_free;
+}
+
+static void use_list_allocator(void) {
+  l1_init = l1_list_init;
+  l1_deinit = l1_list_deinit;
+  l1_malloc = l1_list_malloc;
+  l1_free = l1_list_free;
+}
+
+static void use_chunk_resize(void) {
+  use_chunk_allocator();
+  l1_realloc = l1_chunk_realloc;
+  l1_calloc = l1_chunk_calloc;
+}
+
+static void use_list_resize(void) {
+  use_list_allocator();
+  l1_realloc = l1_list_realloc;
+  l1_calloc = l1_list_calloc;
+}
+
+static void use_libc_allocator(void) {
+  l1_init = NULL;
+  l1_deinit = NULL;
+  l1_malloc = libc_malloc;
+  l1_free = libc_free;
+}
+
+static void use_buddy_allocator(void) {
+  l1_init = l1_buddy_init;
+  l1_deinit = l1_buddy_deinit;
+  l1_malloc = l1_buddy_malloc;
+  l1_free = l1_buddy_free;
+}
+
+/** Helper function:
+ * Monotonic timestamp in nanoseconds
+ */
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** Helper function:
+ * Number of taken chunks in the arena
+ */
+static size_t chunks_taken(void) {
+  size_t taken = 0;
+  for (size_t i = 0; i < l1_chunk_arena_length; i++)
+    taken += IS_CHUNK_TAKEN(i);
+  return taken;
+}
+
+/**
+ * Fills the arena with regions of 1-4 chunks up to `percent` occupancy, frees
+ * a random third of them to punch holes, and then refills to `percent` again.
+ * Latency is then measured on alloc/free pairs of 1-3 chunk regions that keep
+ * the occupancy steady.
+ */
+static void bench_occupancy_at(unsigned percent) {
+  void *live[CHUNK_ARENA_LENGTH];
+  size_t nlive = 0;
+  const size_t target = CHUNK_ARENA_LENGTH * percent / 100;
+
+  use_chunk_allocator();
+  l1_init();
+  srand(percent);
+  for (int pass = 0; pass < 2; pass++) {
+    while (chunks_taken() < target && nlive < CHUNK_ARENA_LENGTH) {
+      void *ptr = l1_malloc((rand() % 4 + 1) * CHUNK_SIZE - 1);
+      if (ptr == NULL)
+        break;
+      live[nlive++] = ptr;
+    }
+    for (size_t i = 0; pass == 0 && i < nlive; i++) {
+      if (rand() % 3 == 0) {
+        l1_free(live[i]);
+        live[i--] = live[--nlive];
+      }
+    }
+  }
+  const size_t occupied = chunks_taken();
+
+  uint64_t alloc_ns = 0, free_ns = 0;
+  unsigned failed = 0;
+  for (unsigned i = 0; i < BENCH_ITERS; i++) {
+    size_t size = (rand() % 3 + 1) * CHUNK_SIZE - 1;
+    uint64_t t0 = now_ns();
+    void *ptr = l1_malloc(size);
+    uint64_t t1 = now_ns();
+    l1_free(ptr);
+    uint64_t t2 = now_ns();
+    alloc_ns += t1 - t0;
+    free_ns += t2 - t1;
+    failed += (ptr == NULL);
+  }
+
+  printf("occupancy %3u%% (%3zu/%d chunks): alloc %7.1f ns  free %7.1f ns"
+         "  failed %u/%d\n", percent, occupied, CHUNK_ARENA_LENGTH,
+         (double)alloc_ns / BENCH_ITERS, (double)free_ns / BENCH_ITERS,
+         failed, BENCH_ITERS);
+
+  for (size_t i = 0; i < nlive; i++)
+    l1_free(live[i]);
+  l1_deinit();
+}
+
+static void bench_occupancy(void) {
+  printf("== chunk allocator alloc/free latency by arena occupancy\n");
+  bench_occupancy_at(25);
+  bench_occupancy_at(50);
+  bench_occupancy_at(90);
+}
+
+/** Helper function:
+ * Request size for the mixed small-object trace: mostly tiny objects, with a
+ * tail up to a couple of KiB
+ */
+static size_t small_object_size(void) {
+  const int r = rand() % 100;
+  if (r < 70)
+    return rand() % 64 + 1;
+  if (r < 90)
+    return rand() % 192 + 65;
+  return rand() % 1792 + 257;
+}
+
+#define TRACE_LIVE 1024
+#define TRACE_OPS 100000
+
+/**
+ * Replays a random small-object trace against the chunk allocator, keeping up
+ * to `TRACE_LIVE` objects alive, and compares the bytes taken from the arena
+ * with the bytes requested by the live objects.
+ */
+static void bench_small_objects(void) {
+  void *live[TRACE_LIVE] = { NULL };
+  size_t sizes[TRACE_LIVE] = { 0 };
+  size_t requested = 0, peak_requested = 0, peak_used = 0;
+  unsigned failed = 0;
+
+  use_chunk_allocator();
+  l1_init();
+  srand(42);
+  for (unsigned op = 0; op < TRACE_OPS; op++) {
+    const unsigned slot = rand() % TRACE_LIVE;
+    if (live[slot] != NULL) {
+      l1_free(live[slot]);
+      requested -= sizes[slot];
+      live[slot] = NULL;
+      continue;
+    }
+    sizes[slot] = small_object_size();
+    live[slot] = l1_malloc(sizes[slot]);
+    if (live[slot] == NULL) {
+      failed++;
+      continue;
+    }
+    requested += sizes[slot];
+    const size_t used = chunks_taken() * CHUNK_SIZE;
+    if (used > peak_used)
+      peak_used = used;
+    if (requested > peak_requested)
+      peak_requested = requested;
+  }
+
+  const size_t used = chunks_taken() * CHUNK_SIZE;
+  printf("== chunk allocator on a mixed small-object trace (%d ops)\n",
+         TRACE_OPS);
+  printf("final: requested %8zu B  used %8zu B  (%.1f%% efficient)\n",
+         requested, used, used ? 100.0 * requested / used : 0.0);
+  printf("peak:  requested %8zu B  used %8zu B\n", peak_requested, peak_used);
+  printf("failed allocations: %u\n", failed);
+
+  for (unsigned i = 0; i < TRACE_LIVE; i++)
+    l1_free(live[i]);
+  l1_deinit();
+}
+
+/**
+ * Counts how many `CHUNK_SIZE` regions can be alive at once before the chunk
+ * allocator has to grow past its first segment.
+ */
+static void bench_region_capacity(void) {
+  void *live[CHUNK_ARENA_LENGTH + 1];
+  size_t nlive = 0;
+
+  use_chunk_allocator();
+  l1_init();
+  while (nlive <= CHUNK_ARENA_LENGTH
+         && (live[nlive] = l1_malloc(CHUNK_SIZE)) != NULL
+         && (char *)live[nlive] < l1_chunk_arena[CHUNK_ARENA_LENGTH])
+    nlive++;
+  printf("== chunk allocator region capacity\n");
+  printf("%zu concurrent %d B regions in a %d-chunk segment\n", nlive,
+         CHUNK_SIZE, CHUNK_ARENA_LENGTH);
+  for (size_t i = 0; i <= nlive && i <= CHUNK_ARENA_LENGTH; i++)
+    l1_free(live[i]);
+  l1_deinit();
+}
+
+#define FRAG_SLOTS 256
+#define FRAG_OPS 4000000
+#define FRAG_WINDOW 500000
+
+/** Helper function:
+ * Free bytes and largest free block of the chunk arena
+ */
+static void chunk_free_space(size_t *total, size_t *largest) {
+  size_t run = 0;
+  *total = *largest = 0;
+  for (size_t i = 0; i < l1_chunk_arena_length; i++) {
+    run = IS_CHUNK_FREE(i) ? run + 1 : 0;
+    *total += IS_CHUNK_FREE(i);
+    if (run > *largest)
+      *largest = run;
+  }
+  *total *= CHUNK_SIZE;
+  *largest *= CHUNK_SIZE;
+}
+
+/** Helper function:
+ * Free bytes and largest free block of the buddy arena
+ */
+static void buddy_free_space(size_t *total, size_t *largest) {
+  *total = *largest = 0;
+  for (unsigned order = 0; order <= BUDDY_MAX_ORDER; order++) {
+    for (l1_buddy_block *b = l1_buddy_free_lists[order]; b; b = b->next)
+      *total += (size_t)BUDDY_MIN_SIZE << order;
+    if (l1_buddy_free_lists[order] != NULL)
+      *largest = (size_t)BUDDY_MIN_SIZE << order;
+  }
+}
+
+/**
+ * Replays a long random trace of allocations and frees with log-uniform sizes
+ * from 16 B to 16 KiB, and reports, for each window of `FRAG_WINDOW` ops, the
+ * failure count and the external fragmentation (1 - largest free block / free
+ * bytes) at the end of the window.
+ */
+static void bench_fragmentation_of(const char *name, void (*use)(void),
+                                   void (*free_space)(size_t *, size_t *)) {
+  static void *live[FRAG_SLOTS];
+  unsigned failed = 0;
+  uint64_t elapsed = 0;
+
+  use();
+  l1_init();
+  srand(7);
+  printf("-- %s\n", name);
+  for (unsigned op = 1; op <= FRAG_OPS; op++) {
+    const unsigned slot = rand() % FRAG_SLOTS;
+    const size_t size = (size_t)16 << (rand() % 11);
+    const uint64_t start = now_ns();
+    if (live[slot] != NULL) {
+      l1_free(live[slot]);
+      live[slot] = NULL;
+    } else {
+      live[slot] = l1_malloc(size);
+      failed += (live[slot] == NULL);
+    }
+    elapsed += now_ns() - start;
+    if (op % FRAG_WINDOW == 0) {
+      size_t total, largest;
+      free_space(&total, &largest);
+      printf("ops %8u: failed %6u  free %7zu B  largest %7zu B  "
+             "fragmentation %.3f\n", op, failed, total, largest,
+             total ? 1.0 - (double)largest / total : 0.0);
+      failed = 0;
+    }
+  }
+
+  printf("average %.1f ns/op\n", (double)elapsed / FRAG_OPS);
+  for (unsigned i = 0; i < FRAG_SLOTS; i++) {
+    l1_free(live[i]);
+    live[i] = NULL;
+  }
+  l1_deinit();
+}
+
+static void bench_fragmentation(void) {
+  printf("== fragmentation over time, %d ops\n", FRAG_OPS);
+  bench_fragmentation_of("chunk", use_chunk_allocator, chunk_free_space);
+  bench_fragmentation_of("buddy", use_buddy_allocator, buddy_free_space);
+}
+
+#define LATENCY_SAMPLES 100000
+#define LATENCY_WINDOW 64
+
+static int compare_u64(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Fills the list heap with `live` objects of 16-64 B and frees every other
+ * one, leaving `live / 2` small free regions that cannot coalesce. Then
+ * measures the latency of allocations of 16-256 B, keeping the last
+ * `LATENCY_WINDOW` of them alive, and reports percentiles.
+ */
+static void bench_list_latency_at(size_t live) {
+  void **objects = malloc(live * sizeof(void *));
+  uint64_t *samples = malloc(LATENCY_SAMPLES * sizeof(uint64_t));
+  void *window[LATENCY_WINDOW] = { NULL };
+  unsigned failed = 0;
+
+  use_list_allocator();
+  l1_init();
+  srand(live);
+  for (size_t i = 0; i < live; i++)
+    objects[i] = l1_malloc(rand() % 49 + 16);
+  for (size_t i = 0; i < live; i += 2) {
+    l1_free(objects[i]);
+    objects[i] = NULL;
+  }
+
+  for (unsigned i = 0; i < LATENCY_SAMPLES; i++) {
+    const size_t size = rand() % 241 + 16;
+    l1_free(window[i % LATENCY_WINDOW]);
+    const uint64_t start = now_ns();
+    window[i % LATENCY_WINDOW] = l1_malloc(size);
+    samples[i] = now_ns() - start;
+    failed += (window[i % LATENCY_WINDOW] == NULL);
+  }
+  qsort(samples, LATENCY_SAMPLES, sizeof(uint64_t), compare_u64);
+  printf("%5zu free regions: p50 %6lu ns  p99 %6lu ns  max %7lu ns"
+         "  failed %u\n", live / 2, samples[LATENCY_SAMPLES / 2],
+         samples[LATENCY_SAMPLES * 99 / 100], samples[LATENCY_SAMPLES - 1],
+         failed);
+
+  for (unsigned i = 0; i < LATENCY_WINDOW; i++)
+    l1_free(window[i]);
+  for (size_t i = 0; i < live; i++)
+    l1_free(objects[i]);
+  l1_deinit();
+  free(samples);
+  free(objects);
+}
+
+#define WALK_FIT 256
+#define WALK_HOLE 16
+
+/**
+ * Lays out `holes` groups of a WALK_FIT B object, a WALK_HOLE B object and
+ * two spacers keeping them from coalescing. Each round frees the large
+ * objects, then the small ones, so that a first fit meets every too-small
+ * hole before the first region that fits, and times the allocations taking
+ * the large regions back. The small holes are then refilled for the next
+ * round.
+ */
+static void bench_list_walk_at(size_t holes) {
+  void **fits = malloc(holes * sizeof(void *));
+  void **small = malloc(holes * sizeof(void *));
+  void **spacers = malloc(2 * holes * sizeof(void *));
+  uint64_t *samples = malloc(LATENCY_SAMPLES * sizeof(uint64_t));
+  unsigned failed = 0;
+
+  use_list_allocator();
+  l1_init();
+  for (size_t i = 0; i < holes; i++) {
+    fits[i] = l1_malloc(WALK_FIT);
+    spacers[2 * i] = l1_malloc(WALK_HOLE);
+    small[i] = l1_malloc(WALK_HOLE);
+    spacers[2 * i + 1] = l1_malloc(WALK_HOLE);
+  }
+
+  for (unsigned taken = 0; taken < LATENCY_SAMPLES;) {
+    for (size_t i = 0; i < holes; i++)
+      l1_free(fits[i]);
+    for (size_t i = 0; i < holes; i++)
+      l1_free(small[i]);
+    for (size_t i = 0; i < holes && taken < LATENCY_SAMPLES; i++) {
+      const uint64_t start = now_ns();
+      fits[i] = l1_malloc(WALK_FIT);
+      samples[taken++] = now_ns() - start;
+      failed += (fits[i] == NULL);
+    }
+    for (size_t i = 0; i < holes; i++)
+      small[i] = l1_malloc(WALK_HOLE);
+  }
+  qsort(samples, LATENCY_SAMPLES, sizeof(uint64_t), compare_u64);
+  printf("%5zu small holes first: p50 %6lu ns  p99 %6lu ns  max %7lu ns"
+         "  failed %u\n", holes, samples[LATENCY_SAMPLES / 2],
+         samples[LATENCY_SAMPLES * 99 / 100], samples[LATENCY_SAMPLES - 1],
+         failed);
+
+  /* The last round may have stopped short of refilling every region */
+  l1_deinit();
+  free(samples);
+  free(spacers);
+  free(small);
+  free(fits);
+}
+
+static void bench_list_latency(void) {
+  printf("== list allocator allocation latency by free list length\n");
+  bench_list_latency_at(64);
+  bench_list_latency_at(1024);
+  bench_list_latency_at(4096);
+  bench_list_latency_at(6144);
+  printf("== list allocator latency with too-small regions before the fit\n");
+  bench_list_walk_at(64);
+  bench_list_walk_at(256);
+  bench_list_walk_at(1024);
+}
+
+#define RSS_BYTES (64 * 1024 * 1024)
+#define RSS_BLOCK (64 * 1024)
+
+/** Helper function:
+ * Reads a "kB" field of /proc/self/status, in KiB
+ */
+static size_t proc_status_kb(const char *field) {
+  char line[128];
+  size_t kb = 0;
+  FILE *status = fopen("/proc/self/status", "r");
+  if (status == NULL)
+    return 0;
+  while (fgets(line, sizeof(line), status) != NULL) {
+    if (strncmp(line, field, strlen(field)) == 0) {
+      sscanf(line + strlen(field), ": %zu", &kb);
+      break;
+    }
+  }
+  fclose(status);
+  return kb;
+}
+
+/** Helper function:
+ * Resets the peak resident set size of the process to the current one
+ */
+static void reset_peak_rss(void) {
+  FILE *refs = fopen("/proc/self/clear_refs", "w");
+  if (refs != NULL) {
+    fputs("5", refs);
+    fclose(refs);
+  }
+}
+
+/**
+ * Allocates and touches `RSS_BYTES` in `RSS_BLOCK` blocks, then frees them
+ * all, and reports the peak and current resident set size on top of the
+ * resident set before the first allocation.
+ */
+static void bench_rss_of(const char *name, void (*use)(void)) {
+  static void *blocks[RSS_BYTES / RSS_BLOCK];
+
+  use();
+  if (l1_init != NULL)
+    l1_init();
+  reset_peak_rss();
+  const size_t base = proc_status_kb("VmRSS");
+  for (size_t i = 0; i < RSS_BYTES / RSS_BLOCK; i++) {
+    blocks[i] = l1_malloc(RSS_BLOCK);
+    if (blocks[i] != NULL)
+      memset(blocks[i], 1, RSS_BLOCK);
+  }
+  const size_t full = proc_status_kb("VmRSS");
+  for (size_t i = 0; i < RSS_BYTES / RSS_BLOCK; i++)
+    l1_free(blocks[i]);
+  printf("%-6s live %6zu KiB  peak %6zu KiB  after free %6zu KiB\n", name,
+         full - base, proc_status_kb("VmHWM") - base,
+         proc_status_kb("VmRSS") - base);
+  if (l1_deinit != NULL)
+    l1_deinit();
+}
+
+
+static void bench_rss(void) {
+  printf("== resident set growth over %d MiB of %d KiB blocks, %zu KiB "
+         "segments\n", RSS_BYTES >> 20, RSS_BLOCK >> 10, l1_segment_size >> 10);
+  bench_rss_of("libc", use_libc_allocator);
+  bench_rss_of("chunk", use_chunk_allocator);
+  bench_rss_of("list", use_list_allocator);
+}
+
+#define HUGE_OPS 2000000
+#define HUGE_BATCH 256
+#define HUGE_LIVE 4
+
+/**
+ * Replays small-object churn in batches of `HUGE_BATCH` ops. With `huge`, a
+ * buffer of 1-8 MiB is allocated or freed between two batches, keeping up to
+ * `HUGE_LIVE` alive. Only the batches are timed. The heap size reported is
+ * the one mapped at the end.
+ */
+static void bench_huge_churn(const char *name, void (*use)(void), int huge,
+                             size_t threshold) {
+  static void *live[TRACE_LIVE];
+  void *buffers[HUGE_LIVE] = { NULL };
+  unsigned failed = 0, huge_failed = 0;
+  uint64_t elapsed = 0;
+
+  use();
+  l1_mmap_threshold = threshold;
+  l1_init();
+  srand(11);
+  for (unsigned op = 0; op < HUGE_OPS; op += HUGE_BATCH) {
+    const uint64_t start = now_ns();
+    for (unsigned i = 0; i < HUGE_BATCH; i++) {
+      const unsigned slot = rand() % TRACE_LIVE;
+      if (live[slot] != NULL) {
+        l1_free(live[slot]);
+        live[slot] = NULL;
+      } else {
+        live[slot] = l1_malloc(small_object_size());
+        failed += (live[slot] == NULL);
+      }
+    }
+    elapsed += now_ns() - start;
+
+    if (huge) {
+      const unsigned slot = rand() % HUGE_LIVE;
+      if (buffers[slot] != NULL) {
+        l1_free(buffers[slot]);
+        buffers[slot] = NULL;
+      } else {
+        buffers[slot] = l1_malloc(((size_t)rand() % 8 + 1) << 20);
+        huge_failed += (buffers[slot] == NULL);
+      }
+    }
+  }
+
+  const size_t heap = (use == use_chunk_allocator)
+                      ? l1_chunk_arena_length * CHUNK_SIZE : l1_list_heap_size;
+  printf("%-6s %-20s %6.2f Mops/s  heap %7zu KiB  failed %u  huge failed %u\n",
+         name, !huge ? "small only" : threshold == SIZE_MAX ? "+ huge in the heap"
+                                                            : "+ huge mapped",
+         HUGE_OPS * 1e3 / elapsed, heap >> 10, failed, huge_failed);
+  for (unsigned i = 0; i < TRACE_LIVE; i++) {
+    l1_free(live[i]);
+    live[i] = NULL;
+  }
+  for (unsigned i = 0; i < HUGE_LIVE; i++)
+    l1_free(buffers[i]);
+  l1_deinit();
+  l1_mmap_threshold = ALLOC8R_MMAP_THRESHOLD;
+}
+
+static void bench_huge(void) {
+  printf("== small-object throughput next to 1-8 MiB buffers, %d ops\n",
+         HUGE_OPS);
+  bench_huge_churn("chunk", use_chunk_allocator, 0, ALLOC8R_MMAP_THRESHOLD);
+  bench_huge_churn("chunk", use_chunk_allocator, 1, ALLOC8R_MMAP_THRESHOLD);
+  bench_huge_churn("chunk", use_chunk_allocator, 1, SIZE_MAX);
+  bench_huge_churn("list", use_list_allocator, 0, ALLOC8R_MMAP_THRESHOLD);
+  bench_huge_churn("list", use_list_allocator, 1, ALLOC8R_MMAP_THRESHOLD);
+  bench_huge_churn("list", use_list_allocator, 1, SIZE_MAX);
+}
+
+#define VECTOR_MIN 16
+#define VECTOR_MAX (128 * 1024)
+#define VECTOR_ROUNDS 200
+#define VECTOR_MAX_COUNT 16
+
+/**
+ * Grows `count` vectors round-robin from `VECTOR_MIN` to `VECTOR_MAX` bytes,
+ * doubling their capacity with l1_realloc and filling the new half, for
+ * `VECTOR_ROUNDS` rounds. A realloc returning the same pointer avoided the
+ * copy of the old contents.
+ */
+static void bench_vector_of(const char *name, void (*use)(void),
+                            unsigned count) {
+  void *vectors[VECTOR_MAX_COUNT];
+  unsigned reallocs = 0, in_place = 0, failed = 0;
+  uint64_t avoided = 0, elapsed = 0;
+
+  use();
+  if (l1_init != NULL)
+    l1_init();
+  for (unsigned round = 0; round < VECTOR_ROUNDS; round++) {
+    for (unsigned v = 0; v < count; v++)
+      vectors[v] = NULL;
+    for (size_t cap = VECTOR_MIN; cap <= VECTOR_MAX; cap *= 2) {
+      for (unsigned v = 0; v < count; v++) {
+        const uint64_t start = now_ns();
+        char *grown = l1_realloc(vectors[v], cap);
+        elapsed += now_ns() - start;
+        if (grown == NULL) {
+          failed++;
+          continue;
+        }
+        if (vectors[v] != NULL) {
+          reallocs++;
+          if (grown == vectors[v]) {
+            in_place++;
+            avoided += cap / 2;
+          }
+        }
+        memset(grown + (cap == VECTOR_MIN ? 0 : cap / 2), v,
+               cap == VECTOR_MIN ? cap : cap / 2);
+        vectors[v] = grown;
+      }
+    }
+    for (unsigned v = 0; v < count; v++)
+      l1_free(vectors[v]);
+  }
+
+  printf("%-6s %2u vectors: %6.1f ns/realloc  in place %5.1f%%  "
+         "copies avoided %6u (%8.1f KiB)  failed %u\n", name, count,
+         (double)elapsed / (reallocs + VECTOR_ROUNDS * count),
+         100.0 * in_place / reallocs, in_place, avoided / 1024.0, failed);
+  if (l1_deinit != NULL)
+    l1_deinit();
+  l1_realloc = libc_realloc;
+  l1_calloc = libc_calloc;
+}
+
+static void bench_vector(void) {
+  printf("== vector doubling from %d B to %d KiB, %d rounds\n", VECTOR_MIN,
+         VECTOR_MAX >> 10, VECTOR_ROUNDS);
+  for (unsigned count = 1; count <= VECTOR_MAX_COUNT; count *= 4) {
+    bench_vector_of("libc", use_libc_allocator, count);
+    bench_vector_of("chunk", use_chunk_resize, count);
+    bench_vector_of("list", use_list_resize, count);
+  }
+}
+
+#define PC_PAIRS_MAX 8
+#define PC_RING 1024
+#define PC_OBJECTS 100000
+
+/* Single-producer single-consumer ring of pointers */
+typedef struct {
+  void *slots[PC_RING];
+  size_t head;   // Written by the producer
+  size_t tail;   // Written by the consumer
+} pc_ring_t;
+
+static pc_ring_t pc_rings[PC_PAIRS_MAX];
+static pthread_mutex_t pc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *locked_list_malloc(size_t size) {
+  pthread_mutex_lock(&pc_lock);
+  void *ptr = l1_list_malloc(size);
+  pthread_mutex_unlock(&pc_lock);
+  return ptr;
+}
+
+static l1_error locked_list_free(void *ptr) {
+  pthread_mutex_lock(&pc_lock);
+  const l1_error err = l1_list_free(ptr);
+  pthread_mutex_unlock(&pc_lock);
+  return err;
+}
+
+static void use_locked_list_allocator(void) {
+  use_list_allocator();
+  l1_malloc = locked_list_malloc;
+  l1_free = locked_list_free;
+}
+
+static void use_mt_allocator(void) {
+  l1_init = l1_mt_init;
+  l1_deinit = l1_mt_deinit;
+  l1_malloc = l1_mt_malloc;
+  l1_free = l1_mt_free;
+}
+
+static void *pc_producer(void *arg) {
+  pc_ring_t *ring = arg;
+  unsigned seed = ring - pc_rings;
+  for (size_t i = 0; i < PC_OBJECTS; i++) {
+    char *ptr = l1_malloc(rand_r(&seed) % 496 + 16);
+    if (ptr != NULL)
+      ptr[0] = 1;
+    while (i - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == PC_RING)
+      sched_yield();
+    ring->slots[i % PC_RING] = ptr;
+    __atomic_store_n(&ring->head, i + 1, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+static void *pc_consumer(void *arg) {
+  pc_ring_t *ring = arg;
+  for (size_t i = 0; i < PC_OBJECTS; i++) {
+    while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == i)
+      sched_yield();
+    l1_free(ring->slots[i % PC_RING]);
+    __atomic_store_n(&ring->tail, i + 1, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+/**
+ * Runs `pairs` producer threads allocating 16-511 B objects and handing them
+ * through a ring to their consumer thread, which frees them, and reports the
+ * throughput of allocations and frees together.
+ */
+static void bench_producer_consumer_of(const char *name, void (*use)(void),
+                                       unsigned pairs) {
+  pthread_t producers[PC_PAIRS_MAX], consumers[PC_PAIRS_MAX];
+
+  use();
+  if (l1_init != NULL)
+    l1_init();
+  memset(pc_rings, 0, sizeof(pc_rings));
+  const uint64_t start = now_ns();
+  for (unsigned i = 0; i < pairs; i++) {
+    pthread_create(&producers[i], NULL, pc_producer, &pc_rings[i]);
+    pthread_create(&consumers[i], NULL, pc_consumer, &pc_rings[i]);
+  }
+  for (unsigned i = 0; i < pairs; i++) {
+    pthread_join(producers[i], NULL);
+    pthread_join(consumers[i], NULL);
+  }
+  const uint64_t elapsed = now_ns() - start;
+
+  printf("%-12s %u pairs: %7.2f Mops/s\n", name, pairs,
+         2.0 * pairs * PC_OBJECTS * 1e3 / elapsed);
+  if (l1_deinit != NULL)
+    l1_deinit();
+}
+
+static void bench_producer_consumer(void) {
+  printf("== producer/consumer threads, %d objects per pair, %ld CPUs\n",
+         PC_OBJECTS, sysconf(_SC_NPROCESSORS_ONLN));
+  for (unsigned pairs = 1; pairs <= PC_PAIRS_MAX; pairs *= 2) {
+    bench_producer_consumer_of("libc", use_libc_allocator, pairs);
+    bench_producer_consumer_of("locked list", use_locked_list_allocator, pairs);
+    bench_producer_consumer_of("mt", use_mt_allocator, pairs);
+  }
+}
+
+typedef struct {
+  const char *name;
+  void (*run)(void);
+} bench_t;
+
+static const bench_t benches[] = {
+  { "occupancy", bench_occupancy },
+  { "small", bench_small_objects },
+  { "regions", bench_region_capacity },
+  { "fragmentation", bench_fragmentation },
+  { "list-latency", bench_list_latency },
+  { "rss", bench_rss },
+  { "huge", bench_huge },
+  { "vector", bench_vector },
+  { "threads", bench_producer_consumer },
+};
+
+int main(int argc, char **argv) {
+  const size_t nbenches = sizeof(benches) / sizeof(benches[0]);
+  int ran = 0;
+
+  for (size_t i = 0; i < nbenches; i++) {
+    if (argc < 2 || strcmp(argv[1], benches[i].name) == 0) {
+      benches[i].run();
+      ran = 1;
+    }
+  }
+  if (!ran) {
+    fprintf(stderr, "Usage: %s [", argv[0]);
+    for (size_t i = 0; i < nbenches; i++)
+      fprintf(stderr, "%s%s", i ? "|" : "", benches[i].name);
+    fprintf(stderr, "]\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
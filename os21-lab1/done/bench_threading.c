@@ -0,0 +1,613 @@
+/**
+ * @file bench_threading.c
+ * @brief Micro-benchmarks for the green threads and their scheduler
+ *
+ * Every benchmark is a subcommand; run without arguments to run them all.
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "l1_io.h"
+#include "malloc.h"
+#include "schedule.h"
+#include "sched_policy.h"
+#include "stack.h"
+#include "thread.h"
+#include "timer_wheel.h"
+
+void *(*l1_malloc)(size_t) = libc_malloc;
+l1_error (*l1_free)(void *) = libc_free;
+void (*l1_init)(void) = NULL;
+void (*l1_deinit)(void) = NULL;
+void *(*l1_realloc)(void *, size_t) = libc_realloc;
+void *(*l1_calloc)(size_t, size_t) = libc_calloc;
+void *(*l1_memalign)(size_t, size_t) = libc_memalign;
+
+#define CHURN_THREADS 300000
+#define CHURN_BATCH 64
+
+/** Helper function:
+ * Monotonic timestamp in nanoseconds
+ */
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** Helper function:
+ * Runs `root` as the only thread until every thread has finished
+ */
+static void run_threads(sched_policy policy, void *(*root)(void *), void *arg) {
+  l1_tid tid;
+  initialize_scheduler(policy);
+  l1_thread_create(&tid, root, arg);
+  schedule();
+  clean_up_scheduler();
+}
+
+static void *churn_noop(void *arg) {
+  return arg;
+}
+
+/**
+ * Creates CHURN_THREADS threads doing nothing, `batch` at a time, joining
+ * each batch before creating the next.
+ */
+static void *churn_root(void *arg) {
+  const unsigned batch = *(unsigned *)arg;
+  l1_tid tids[CHURN_BATCH];
+
+  for (unsigned done = 0; done < CHURN_THREADS; done += batch) {
+    for (unsigned i = 0; i < batch; i++)
+      l1_thread_create(&tids[i], churn_noop, NULL);
+    for (unsigned i = 0; i < batch; i++)
+      l1_thread_join(tids[i], NULL);
+  }
+  return NULL;
+}
+
+static void bench_churn_of(const char *name, unsigned limit, unsigned batch) {
+  l1_thread_pool_limit = limit;
+  l1_stack_pool_limit = limit;
+  const uint64_t start = now_ns();
+  run_threads(l1_round_robin_policy, churn_root, &batch);
+  const uint64_t elapsed = now_ns() - start;
+  printf("%-10s batch %2u: %8.0f threads/s\n", name, batch,
+         CHURN_THREADS * 1e9 / elapsed);
+}
+
+static void bench_churn(void) {
+  printf("== create/join churn, %d short-lived threads\n", CHURN_THREADS);
+  for (unsigned batch = 1; batch <= CHURN_BATCH; batch *= 8) {
+    bench_churn_of("unpooled", 0, batch);
+    bench_churn_of("pooled", STACK_POOL_MAX, batch);
+  }
+}
+
+#define PINGPONG_ROUNDS 1000000
+
+static l1_tid pingpong_tids[2];
+
+static void *pingpong_player(void *arg) {
+  const l1_tid other = pingpong_tids[!(uintptr_t)arg];
+  for (unsigned i = 0; i < PINGPONG_ROUNDS; i++)
+    yield(other);
+  return NULL;
+}
+
+static void *pingpong_root(void *arg) {
+  l1_thread_create(&pingpong_tids[0], pingpong_player, (void *)0);
+  l1_thread_create(&pingpong_tids[1], pingpong_player, (void *)1);
+  l1_thread_join(pingpong_tids[0], NULL);
+  l1_thread_join(pingpong_tids[1], NULL);
+  return NULL;
+}
+
+/**
+ * Two threads yield to each other PINGPONG_ROUNDS times each, and the
+ * context switches per second are reported.
+ */
+static void bench_pingpong_of(const char *name, int direct,
+                              sched_policy policy) {
+  l1_yield_direct = direct;
+  const uint64_t start = now_ns();
+  run_threads(policy, pingpong_root, NULL);
+  const uint64_t elapsed = now_ns() - start;
+  printf("%-22s %6.2f M switches/s\n", name,
+         2.0 * PINGPONG_ROUNDS * 1e3 / elapsed);
+  l1_yield_direct = 1;
+}
+
+static void bench_pingpong(void) {
+  printf("== ping-pong yield, %d rounds per thread\n", PINGPONG_ROUNDS);
+  bench_pingpong_of("round robin via tsys", 0, l1_round_robin_policy);
+  bench_pingpong_of("round robin direct", 1, l1_round_robin_policy);
+  bench_pingpong_of("mlfq via tsys", 0, l1_mlfq_policy);
+  bench_pingpong_of("mlfq direct", 1, l1_mlfq_policy);
+}
+
+#define JOIN_THREADS 50000
+#define JOIN_WAVE 10000
+
+static double join_rate;
+
+/**
+ * Creates JOIN_THREADS threads in waves, letting each wave finish so that
+ * they wait as zombies, and then joins them all in a random order.
+ */
+static void *join_root(void *arg) {
+  l1_tid *tids = malloc(JOIN_THREADS * sizeof(l1_tid));
+  if (tids == NULL)
+    return NULL;
+  for (unsigned i = 0; i < JOIN_THREADS; i++) {
+    l1_thread_create(&tids[i], churn_noop, NULL);
+    if ((i + 1) % JOIN_WAVE == 0)
+      yield(-1);
+  }
+
+  srand(JOIN_THREADS);
+  for (unsigned i = JOIN_THREADS - 1; i > 0; i--) {
+    const unsigned j = rand() % (i + 1);
+    const l1_tid tmp = tids[i];
+    tids[i] = tids[j];
+    tids[j] = tmp;
+  }
+
+  const uint64_t start = now_ns();
+  for (unsigned i = 0; i < JOIN_THREADS; i++)
+    l1_thread_join(tids[i], NULL);
+  join_rate = JOIN_THREADS * 1e9 / (now_ns() - start);
+  free(tids);
+  return NULL;
+}
+
+static void bench_join(void) {
+  printf("== join %d zombie threads in random order\n", JOIN_THREADS);
+  run_threads(l1_round_robin_policy, join_root, NULL);
+  printf("%.0f joins/s\n", join_rate);
+}
+
+#define EXIT_PAIRS 10000
+
+static uint64_t exit_start;
+
+static void *exit_worker(void *arg) {
+  /* Let every waiter block before exiting */
+  yield(-1);
+  return arg;
+}
+
+static void *exit_waiter(void *arg) {
+  l1_thread_join(*(l1_tid *)arg, NULL);
+  return NULL;
+}
+
+/**
+ * EXIT_PAIRS waiters block joining one worker each, and then the workers
+ * exit one after the other while all the other waiters stay blocked.
+ */
+static void *exit_root(void *arg) {
+  l1_tid *workers = malloc(EXIT_PAIRS * sizeof(l1_tid));
+  if (workers == NULL)
+    return NULL;
+  for (unsigned i = 0; i < EXIT_PAIRS; i++)
+    l1_thread_create(&workers[i], exit_worker, NULL);
+  for (unsigned i = 0; i < EXIT_PAIRS; i++) {
+    l1_tid waiter;
+    l1_thread_create(&waiter, exit_waiter, &workers[i]);
+  }
+  exit_start = now_ns();
+  /* The workers' IDs are read by the waiters until they all have joined */
+  for (unsigned i = 0; i < EXIT_PAIRS; i++)
+    yield(-1);
+  free(workers);
+  return NULL;
+}
+
+static void bench_exit(void) {
+  printf("== %d threads exiting with %d blocked joiners\n", EXIT_PAIRS,
+         EXIT_PAIRS);
+  run_threads(l1_round_robin_policy, exit_root, NULL);
+  printf("%.0f exits/s\n", EXIT_PAIRS * 1e9 / (now_ns() - exit_start));
+}
+
+#define DECISION_THREADS 10000
+#define DECISION_YIELDS 20
+
+static double decision_rate;
+
+static void *decision_worker(void *arg) {
+  for (unsigned i = 0; i < DECISION_YIELDS; i++)
+    yield(-1);
+  return arg;
+}
+
+/**
+ * DECISION_THREADS threads all yield DECISION_YIELDS times, so that the
+ * policy always chooses among about DECISION_THREADS runnable threads.
+ */
+static void *decision_root(void *arg) {
+  l1_tid *tids = malloc(DECISION_THREADS * sizeof(l1_tid));
+  if (tids == NULL)
+    return NULL;
+  for (unsigned i = 0; i < DECISION_THREADS; i++)
+    l1_thread_create(&tids[i], decision_worker, NULL);
+  const uint64_t start = now_ns();
+  for (unsigned i = 0; i < DECISION_THREADS; i++)
+    l1_thread_join(tids[i], NULL);
+  decision_rate = (double)DECISION_THREADS * (DECISION_YIELDS + 1) * 1e9
+                  / (now_ns() - start);
+  free(tids);
+  return NULL;
+}
+
+static void bench_decisions_of(const char *name, sched_policy policy) {
+  run_threads(policy, decision_root, NULL);
+  printf("%-12s %10.0f decisions/s\n", name, decision_rate);
+}
+
+static void bench_decisions(void) {
+  printf("== scheduling decisions with %d runnable threads\n",
+         DECISION_THREADS);
+  bench_decisions_of("round robin", l1_round_robin_policy);
+  bench_decisions_of("mlfq", l1_mlfq_policy);
+  bench_decisions_of("cfs", l1_cfs_policy);
+}
+
+#define FAIR_THREADS 2000
+#define FAIR_RUN_NS 2000000000ull
+
+static uint64_t fair_deadline;
+static uint64_t fair_cpu_ns[FAIR_THREADS];
+
+/**
+ * Burns CPU in bursts of 1 to 4 units, yielding after each, until the
+ * deadline, and accounts for the time it ran.
+ */
+static void *fair_worker(void *arg) {
+  const uintptr_t id = (uintptr_t)arg;
+  const unsigned units = 1 + id % 4;
+  while (now_ns() < fair_deadline) {
+    const uint64_t start = now_ns();
+    for (volatile unsigned i = 0; i < units * 2000; i++)
+      ;
+    fair_cpu_ns[id] += now_ns() - start;
+    yield(-1);
+  }
+  return NULL;
+}
+
+static void *fair_root(void *arg) {
+  l1_tid *tids = malloc(FAIR_THREADS * sizeof(l1_tid));
+  if (tids == NULL)
+    return NULL;
+  memset(fair_cpu_ns, 0, sizeof(fair_cpu_ns));
+  for (uintptr_t i = 0; i < FAIR_THREADS; i++)
+    l1_thread_create(&tids[i], fair_worker, (void *)i);
+  /* The workers stop by themselves: under a fair policy, this thread is
+   * charged for the creations and would only get back late to stop them */
+  fair_deadline = now_ns() + FAIR_RUN_NS;
+  for (unsigned i = 0; i < FAIR_THREADS; i++)
+    l1_thread_join(tids[i], NULL);
+  free(tids);
+  return NULL;
+}
+
+/**
+ * Runs FAIR_THREADS CPU-bound threads with bursts of different lengths for
+ * FAIR_RUN_NS, and reports how evenly the CPU was shared: the coefficient of
+ * variation of the threads' run times, 0 being perfectly fair.
+ */
+static void bench_fairness_of(const char *name, sched_policy policy) {
+  run_threads(policy, fair_root, NULL);
+  double mean = 0, var = 0;
+  for (unsigned i = 0; i < FAIR_THREADS; i++)
+    mean += fair_cpu_ns[i];
+  mean /= FAIR_THREADS;
+  for (unsigned i = 0; i < FAIR_THREADS; i++)
+    var += (fair_cpu_ns[i] - mean) * (fair_cpu_ns[i] - mean);
+  var /= FAIR_THREADS;
+  printf("%-16s mean %8.2f ms, cv %.3f\n", name, mean / 1e6,
+         sqrt(var) / mean);
+}
+
+static void bench_fairness(void) {
+  printf("== fairness of %d CPU-bound threads over %.1f s\n", FAIR_THREADS,
+         FAIR_RUN_NS / 1e9);
+  bench_fairness_of("round robin", l1_round_robin_policy);
+  bench_fairness_of("smallest cycles", l1_smallest_cycles_policy);
+  bench_fairness_of("mlfq", l1_mlfq_policy);
+  bench_fairness_of("cfs", l1_cfs_policy);
+}
+
+#define CLOCK_READS 10000000
+
+/**
+ * Reports, for every clock backend, the cost of reading it and the cost of a
+ * yield through schedule() with its accounting on that clock.
+ */
+static void bench_clocks_of(const char *name, l1_clock clock) {
+  if (l1_time_set_clock(clock) != SUCCESS) {
+    printf("%-10s unavailable\n", name);
+    return;
+  }
+  l1_time t;
+  uint64_t start = now_ns();
+  for (unsigned i = 0; i < CLOCK_READS; i++)
+    l1_time_get(&t);
+  const double read_ns = (double)(now_ns() - start) / CLOCK_READS;
+
+  l1_yield_direct = 0;
+  start = now_ns();
+  run_threads(l1_round_robin_policy, pingpong_root, NULL);
+  const double yield_ns = (double)(now_ns() - start) / (2.0 * PINGPONG_ROUNDS);
+  l1_yield_direct = 1;
+  printf("%-10s %6.1f ns/read %7.1f ns/schedule\n", name, read_ns, yield_ns);
+}
+
+static void bench_clocks(void) {
+  printf("== clock backends, %d reads and %d yields via tsys per thread\n",
+         CLOCK_READS, PINGPONG_ROUNDS);
+  bench_clocks_of("unix", L1_CLOCK_UNIX);
+  bench_clocks_of("monotonic", L1_CLOCK_MONOTONIC);
+  bench_clocks_of("tsc", L1_CLOCK_TSC);
+  l1_time_set_clock(L1_CLOCK_MONOTONIC);
+}
+
+#define WHEEL_TIMERS 100000
+#define WHEEL_REARMS 2000000
+#define WHEEL_HORIZON (10 * L1_TIME_S)
+
+/** Helper function:
+ * Deadline of a timer armed at `now`, uniform over the next WHEEL_HORIZON
+ */
+static l1_time wheel_deadline(l1_time now) {
+  return now + 1 + ((l1_time)rand() << 31 | rand()) % WHEEL_HORIZON;
+}
+
+/**
+ * Drives a timer wheel on a simulated clock with WHEEL_TIMERS timers
+ * pending: fills it, re-arms every timer as it expires while the clock runs
+ * WHEEL_REARMS steps, then drains it.
+ */
+static void bench_timers(void) {
+  static l1_timer_wheel wheel;
+  l1_timer *timers = malloc(WHEEL_TIMERS * sizeof(l1_timer));
+  if (timers == NULL)
+    return;
+  memset(&wheel, 0, sizeof(wheel));
+  srand(1);
+  printf("== timer wheel with %d pending timers over %.0f s\n", WHEEL_TIMERS,
+         (double)WHEEL_HORIZON / L1_TIME_S);
+
+  l1_time now = 0;
+  uint64_t start = now_ns();
+  for (unsigned i = 0; i < WHEEL_TIMERS; i++)
+    timer_wheel_add(&wheel, &timers[i], wheel_deadline(now));
+  uint64_t elapsed = now_ns() - start;
+  printf("insert           %6.2f M timers/s\n", WHEEL_TIMERS * 1e3 / elapsed);
+
+  /* Each step lasts as long as one timer on average, so that the wheel
+   * keeps WHEEL_TIMERS timers */
+  const l1_time step = WHEEL_HORIZON / 2 / WHEEL_TIMERS;
+  uint64_t rearmed = 0;
+  start = now_ns();
+  for (unsigned i = 0; i < WHEEL_REARMS; i++) {
+    now += step;
+    l1_timer *timer = timer_wheel_expire(&wheel, now);
+    while (timer != NULL) {
+      l1_timer *next = timer->next;
+      timer_wheel_add(&wheel, timer, wheel_deadline(now));
+      rearmed++;
+      timer = next;
+    }
+  }
+  elapsed = now_ns() - start;
+  printf("expire + re-arm  %6.2f M timers/s, %6.2f M steps/s\n",
+         rearmed * 1e3 / elapsed, WHEEL_REARMS * 1e3 / elapsed);
+
+  uint64_t expired = 0;
+  start = now_ns();
+  while (wheel.count > 0) {
+    l1_time when;
+    timer_wheel_next(&wheel, &when);
+    now = (when > now) ? when : now;
+    for (l1_timer *t = timer_wheel_expire(&wheel, now); t != NULL; t = t->next)
+      expired++;
+  }
+  elapsed = now_ns() - start;
+  printf("drain            %6.2f M timers/s\n", expired * 1e3 / elapsed);
+  free(timers);
+}
+
+#define ECHO_CONNS 2000
+#define ECHO_REQUESTS 50
+#define ECHO_SIZE 64
+
+static int echo_listener;
+static struct sockaddr_in echo_addr;
+static unsigned echo_conns;
+static uint64_t *echo_latency_ns;
+static unsigned echo_done;
+static unsigned echo_failed;
+
+/** Helper function:
+ * Reads exactly `count` bytes, or fails
+ */
+static int echo_read_full(int fd, char *buf, size_t count) {
+  while (count > 0) {
+    const ssize_t n = l1_read(fd, buf, count);
+    if (n <= 0)
+      return -1;
+    buf += n;
+    count -= n;
+  }
+  return 0;
+}
+
+static void *echo_server(void *arg) {
+  const int conn = (int)(intptr_t)arg;
+  char buf[ECHO_SIZE];
+  ssize_t n;
+  while ((n = l1_read(conn, buf, sizeof(buf))) > 0) {
+    if (l1_write(conn, buf, n) != n)
+      break;
+  }
+  close(conn);
+  return NULL;
+}
+
+static void *echo_acceptor(void *arg) {
+  l1_tid tid;
+  for (unsigned i = 0; i < echo_conns; i++) {
+    const int conn = l1_accept(echo_listener, NULL, NULL);
+    if (conn < 0)
+      break;
+    l1_thread_create(&tid, echo_server, (void *)(intptr_t)conn);
+  }
+  return NULL;
+}
+
+/**
+ * Connects and sends ECHO_REQUESTS messages of ECHO_SIZE bytes one after the
+ * other, timing each round trip.
+ */
+static void *echo_client(void *arg) {
+  uint64_t *latency = echo_latency_ns + (uintptr_t)arg * ECHO_REQUESTS;
+  char out[ECHO_SIZE], in[ECHO_SIZE];
+  memset(out, 'x', sizeof(out));
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0 || l1_connect(fd, (struct sockaddr *)&echo_addr,
+                           sizeof(echo_addr)) != 0) {
+    echo_failed++;
+    if (fd >= 0)
+      close(fd);
+    return NULL;
+  }
+  for (unsigned i = 0; i < ECHO_REQUESTS; i++) {
+    const uint64_t start = now_ns();
+    if (l1_write(fd, out, sizeof(out)) != sizeof(out)
+        || echo_read_full(fd, in, sizeof(in)) != 0) {
+      echo_failed++;
+      break;
+    }
+    latency[i] = now_ns() - start;
+    echo_done++;
+  }
+  close(fd);
+  return NULL;
+}
+
+static void *echo_root(void *arg) {
+  l1_tid tid;
+  l1_thread_create(&tid, echo_acceptor, NULL);
+  for (uintptr_t i = 0; i < echo_conns; i++)
+    l1_thread_create(&tid, echo_client, (void *)i);
+  return NULL;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Runs an echo server and ECHO_CONNS clients over loopback TCP, every
+ * connection served by its own thread, and reports the requests per second
+ * and the round-trip latencies.
+ */
+static void bench_echo(void) {
+  /* Two descriptors per connection, on both ends */
+  struct rlimit limit;
+  echo_conns = ECHO_CONNS;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < 2 * ECHO_CONNS + 64)
+      echo_conns = (limit.rlim_cur - 64) / 2;
+  }
+
+  echo_listener = socket(AF_INET, SOCK_STREAM, 0);
+  memset(&echo_addr, 0, sizeof(echo_addr));
+  echo_addr.sin_family = AF_INET;
+  echo_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(echo_addr);
+  if (echo_listener < 0
+      || bind(echo_listener, (struct sockaddr *)&echo_addr, len) != 0
+      || listen(echo_listener, echo_conns) != 0
+      || getsockname(echo_listener, (struct sockaddr *)&echo_addr, &len) != 0) {
+    perror("echo listener");
+    return;
+  }
+  echo_latency_ns = calloc((size_t)echo_conns * ECHO_REQUESTS,
+                           sizeof(uint64_t));
+  if (echo_latency_ns == NULL) {
+    close(echo_listener);
+    return;
+  }
+  echo_done = echo_failed = 0;
+
+  printf("== loopback echo, %u connections x %d requests of %d bytes\n",
+         echo_conns, ECHO_REQUESTS, ECHO_SIZE);
+  const uint64_t start = now_ns();
+  run_threads(l1_round_robin_policy, echo_root, NULL);
+  const uint64_t elapsed = now_ns() - start;
+  close(echo_listener);
+
+  /* Failed connections leave zeroes, sorted first and skipped */
+  const size_t total = (size_t)echo_conns * ECHO_REQUESTS;
+  qsort(echo_latency_ns, total, sizeof(uint64_t), compare_u64);
+  const uint64_t *done = echo_latency_ns + (total - echo_done);
+  printf("%u requests, %u failed connections\n", echo_done, echo_failed);
+  if (echo_done > 0)
+    printf("%.0f req/s, latency p50 %.1f us, p99 %.1f us, max %.1f us\n",
+           echo_done * 1e9 / elapsed, done[echo_done / 2] / 1e3,
+           done[echo_done * 99ull / 100] / 1e3, done[echo_done - 1] / 1e3);
+  free(echo_latency_ns);
+}
+
+typedef struct {
+  const char *name;
+  void (*run)(void);
+} bench_t;
+
+static const bench_t benches[] = {
+  { "churn", bench_churn },
+  { "pingpong", bench_pingpong },
+  { "join", bench_join },
+  { "exit", bench_exit },
+  { "decisions", bench_decisions },
+  { "fairness", bench_fairness },
+  { "clocks", bench_clocks },
+  { "timers", bench_timers },
+  { "echo", bench_echo },
+};
+
+int main(int argc, char **argv) {
+  const size_t nbenches = sizeof(benches) / sizeof(benches[0]);
+  int ran = 0;
+
+  for (size_t i = 0; i < nbenches; i++) {
+    if (argc < 2 || strcmp(argv[1], benches[i].name) == 0) {
+      benches[i].run();
+      ran = 1;
+    }
+  }
+  if (!ran) {
+    fprintf(stderr, "Usage: %s [", argv[0]);
+    for (size_t i = 0; i < nbenches; i++)
+      fprintf(stderr, "%s%s", i ? "|" : "", benches[i].name);
+    fprintf(stderr, "]\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
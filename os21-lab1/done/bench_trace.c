@@ -0,0 +1,453 @@
+/**
+ * @file bench_trace.c
+ * @brief Trace-replay benchmark driver for the custom allocators
+ *
+ * A trace is a text file with one event per line:
+ *
+ *   a <id> <size>    allocate <size> bytes as object <id>
+ *   r <id> <size>    reallocate object <id> to <size> bytes
+ *   f <id>           free object <id>
+ *
+ * Lines starting with '#' are comments. Each trace is replayed against libc,
+ * the chunk allocator and the list allocator, each in a child process of its
+ * own, so that their footprints do not add up.
+ *
+ * Usage:
+ *   bench_trace                   generate and replay every synthetic trace
+ *   bench_trace <shape>           generate and replay one synthetic trace
+ *   bench_trace gen <shape> [n]   write a synthetic trace of n events
+ *   bench_trace <file>            replay a recorded trace
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "malloc.h"
+
+void *(*l1_malloc)(size_t) = libc_malloc;
+l1_error (*l1_free)(void *) = libc_free;
+void (*l1_init)(void) = NULL;
+void (*l1_deinit)(void) = NULL;
+void *(*l1_realloc)(void *, size_t) = libc_realloc;
+void *(*l1_calloc)(size_t, size_t) = libc_calloc;
+void *(*l1_memalign)(size_t, size_t) = libc_memalign;
+
+#define TRACE_DEFAULT_EVENTS 1000000
+
+typedef struct {
+  char op;        // 'a', 'r' or 'f'
+  unsigned id;
+  size_t size;
+} trace_event_t;
+
+typedef struct {
+  trace_event_t *events;
+  size_t length;
+  size_t capacity;
+  unsigned ids;   // One more than the largest object id
+} trace_t;
+
+/** Helper function:
+ * Appends an event to a trace
+ */
+static void trace_push(trace_t *trace, char op, unsigned id, size_t size) {
+  if (trace->length == trace->capacity) {
+    trace->capacity = trace->capacity ? 2 * trace->capacity : 1024;
+    trace->events = realloc(trace->events,
+                            trace->capacity * sizeof(trace_event_t));
+    if (trace->events == NULL) {
+      printf("Unable to allocate %zu trace events\n", trace->capacity);
+      exit(1);
+    }
+  }
+  trace->events[trace->length++] = (trace_event_t){ op, id, size };
+  if (id >= trace->ids)
+    trace->ids = id + 1;
+}
+
+/** Helper function:
+ * Reads a trace file. Malformed lines are reported and skipped.
+ */
+static int trace_read(const char *path, trace_t *trace) {
+  char line[128];
+  unsigned lineno = 0;
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+    return -1;
+
+  while (fgets(line, sizeof(line), file) != NULL) {
+    char op = 0;
+    unsigned id;
+    size_t size = 0;
+    lineno++;
+    /* Skip the rest of an overlong line rather than parse it as an event */
+    if (strchr(line, '\n') == NULL && !feof(file)) {
+      fprintf(stderr, "%s:%u: line too long\n", path, lineno);
+      int c;
+      while ((c = fgetc(file)) != EOF && c != '\n')
+        ;
+      continue;
+    }
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+    const int fields = sscanf(line, " %c %u %zu", &op, &id, &size);
+    if (fields == EOF) // Only whitespace
+      continue;
+    if ((op == 'f' && fields >= 2) || ((op == 'a' || op == 'r') && fields == 3))
+      trace_push(trace, op, id, size);
+    else
+      fprintf(stderr, "%s:%u: malformed event\n", path, lineno);
+  }
+  fclose(file);
+  return 0;
+}
+
+/****** Synthetic traces ******/
+
+/** Helper function:
+ * Small object size: mostly tiny, with a tail up to a couple of KiB
+ */
+static size_t small_size(void) {
+  const int r = rand() % 100;
+  if (r < 70)
+    return rand() % 64 + 1;
+  if (r < 90)
+    return rand() % 192 + 65;
+  return rand() % 1792 + 257;
+}
+
+#define CHURN_LIVE 4096
+
+/**
+ * Small-object churn: random allocations, frees and occasional reallocations
+ * over a fixed set of slots.
+ */
+static void gen_churn(trace_t *trace, size_t events) {
+  char live[CHURN_LIVE] = { 0 };
+  while (trace->length < events) {
+    const unsigned id = rand() % CHURN_LIVE;
+    if (!live[id]) {
+      trace_push(trace, 'a', id, small_size());
+      live[id] = 1;
+    } else if (rand() % 8 == 0) {
+      trace_push(trace, 'r', id, small_size());
+    } else {
+      trace_push(trace, 'f', id, 0);
+      live[id] = 0;
+    }
+  }
+  for (unsigned id = 0; id < CHURN_LIVE; id++)
+    if (live[id])
+      trace_push(trace, 'f', id, 0);
+}
+
+#define PHASE_OBJECTS 20000
+#define PHASE_SURVIVORS 50
+
+/**
+ * Phased lifetimes: each phase allocates a burst of objects and frees them
+ * all at its end, except for a few survivors that live until the end of the
+ * trace, as request-scoped data next to long-lived caches.
+ */
+static void gen_phased(trace_t *trace, size_t events) {
+  unsigned next_id = 0, survivors = 0;
+  const unsigned first_survivor = 2 * PHASE_OBJECTS;
+  while (trace->length < events) {
+    const unsigned first = next_id;
+    const unsigned objects = PHASE_OBJECTS / 2 + rand() % PHASE_OBJECTS;
+    for (unsigned i = 0; i < objects; i++)
+      trace_push(trace, 'a', next_id++, small_size());
+    for (unsigned i = 0; i < PHASE_SURVIVORS; i++)
+      trace_push(trace, 'a', first_survivor + survivors++, small_size() * 4);
+    for (unsigned id = first; id < next_id; id++)
+      trace_push(trace, 'f', id, 0);
+    /* Ids of freed objects are reused by the next phase */
+    next_id = 0;
+  }
+  for (unsigned i = 0; i < survivors; i++)
+    trace_push(trace, 'f', first_survivor + i, 0);
+}
+
+#define MIXED_SMALL 2048
+#define MIXED_LARGE 8
+
+/**
+ * A few large buffers of 64 KiB to 4 MiB, reallocated and replaced from time
+ * to time, in the middle of many small objects.
+ */
+static void gen_mixed(trace_t *trace, size_t events) {
+  char live[MIXED_SMALL + MIXED_LARGE] = { 0 };
+  while (trace->length < events) {
+    if (rand() % 64 == 0) {
+      const unsigned id = MIXED_SMALL + rand() % MIXED_LARGE;
+      const size_t size = ((size_t)64 * 1024) << (rand() % 7);
+      if (!live[id])
+        trace_push(trace, 'a', id, size);
+      else if (rand() % 2)
+        trace_push(trace, 'r', id, size);
+      else
+        trace_push(trace, 'f', id, 0);
+      live[id] ^= (trace->events[trace->length - 1].op != 'r');
+      continue;
+    }
+    const unsigned id = rand() % MIXED_SMALL;
+    trace_push(trace, live[id] ? 'f' : 'a', id, live[id] ? 0 : small_size());
+    live[id] ^= 1;
+  }
+  for (unsigned id = 0; id < MIXED_SMALL + MIXED_LARGE; id++)
+    if (live[id])
+      trace_push(trace, 'f', id, 0);
+}
+
+typedef struct {
+  const char *name;
+  void (*generate)(trace_t *, size_t);
+} shape_t;
+
+static const shape_t shapes[] = {
+  { "churn", gen_churn },
+  { "phased", gen_phased },
+  { "mixed", gen_mixed },
+};
+#define SHAPES (sizeof(shapes) / sizeof(shapes[0]))
+
+/****** Replay ******/
+
+static void use_libc(void) {
+  l1_init = NULL;
+  l1_deinit = NULL;
+  l1_malloc = libc_malloc;
+  l1_free = libc_free;
+  l1_realloc = libc_realloc;
+}
+
+static void use_chunk(void) {
+  l1_init = l1_chunk_init;
+  l1_deinit = l1_chunk_deinit;
+  l1_malloc = l1_chunk_malloc;
+  l1_free = l1_chunk_free;
+  l1_realloc = l1_chunk_realloc;
+}
+
+static void use_list(void) {
+  l1_init = l1_list_init;
+  l1_deinit = l1_list_deinit;
+  l1_malloc = l1_list_malloc;
+  l1_free = l1_list_free;
+  l1_realloc = l1_list_realloc;
+}
+
+/** Helper function:
+ * External fragmentation of the chunk arena: 1 - largest free run / free
+ */
+static double chunk_fragmentation(void) {
+  size_t run = 0, largest = 0, total = 0;
+  for (size_t i = 0; i < l1_chunk_arena_length; i++) {
+    run = IS_CHUNK_FREE(i) ? run + 1 : 0;
+    total += IS_CHUNK_FREE(i);
+    if (run > largest)
+      largest = run;
+  }
+  return total ? 1.0 - (double)largest / total : 0.0;
+}
+
+/** Helper function:
+ * External fragmentation of the list heap: 1 - largest free region / free
+ */
+static double list_fragmentation(void) {
+  size_t largest = 0, total = 0;
+  for (unsigned bin = 0; bin < LIST_BINS; bin++) {
+    for (l1_list_meta *cur = l1_list_bins[bin]; cur != NULL; cur = cur->next) {
+      total += cur->capacity;
+      if (cur->capacity > largest)
+        largest = cur->capacity;
+    }
+  }
+  return total ? 1.0 - (double)largest / total : 0.0;
+}
+
+typedef struct {
+  const char *name;
+  void (*use)(void);
+  double (*fragmentation)(void);
+} allocator_t;
+
+static const allocator_t allocators[] = {
+  { "libc", use_libc, NULL },
+  { "chunk", use_chunk, chunk_fragmentation },
+  { "list", use_list, list_fragmentation },
+};
+#define ALLOCATORS (sizeof(allocators) / sizeof(allocators[0]))
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** Helper function:
+ * Reads a "kB" field of /proc/self/status, in KiB
+ */
+static size_t proc_status_kb(const char *field) {
+  char line[128];
+  size_t kb = 0;
+  FILE *status = fopen("/proc/self/status", "r");
+  if (status == NULL)
+    return 0;
+  while (fgets(line, sizeof(line), status) != NULL) {
+    if (strncmp(line, field, strlen(field)) == 0) {
+      sscanf(line + strlen(field), ": %zu", &kb);
+      break;
+    }
+  }
+  fclose(status);
+  return kb;
+}
+
+/** Helper function:
+ * Writes a byte in every page of a buffer, as its owner would
+ */
+static void touch(char *ptr, size_t size) {
+  for (size_t off = 0; off < size; off += 4096)
+    ptr[off] = 1;
+}
+
+/**
+ * Replays a trace against an allocator, in a child process. The peak
+ * footprint is the growth of the peak resident set over the resident set
+ * before the replay; fragmentation is sampled as the live bytes reach new
+ * peaks.
+ */
+static void replay(const trace_t *trace, const allocator_t *allocator) {
+  fflush(stdout);
+  const pid_t pid = fork();
+  if (pid != 0) {
+    waitpid(pid, NULL, 0);
+    return;
+  }
+
+  void **objects = calloc(trace->ids, sizeof(void *));
+  size_t *sizes = calloc(trace->ids, sizeof(size_t));
+  size_t live = 0, peak_live = 0;
+  unsigned failed = 0;
+  double fragmentation = 0.0;
+  if (objects == NULL || sizes == NULL) {
+    printf("Unable to allocate %u trace objects\n", trace->ids);
+    exit(1);
+  }
+
+  allocator->use();
+  if (l1_init != NULL)
+    l1_init();
+  FILE *refs = fopen("/proc/self/clear_refs", "w");
+  if (refs != NULL) {
+    fputs("5", refs);
+    fclose(refs);
+  }
+  const size_t base = proc_status_kb("VmRSS");
+
+  uint64_t elapsed = 0;
+  for (size_t i = 0; i < trace->length; i++) {
+    const trace_event_t *ev = &trace->events[i];
+    void *ptr;
+    const uint64_t start = now_ns();
+    switch (ev->op) {
+    case 'a':
+      ptr = l1_malloc(ev->size);
+      break;
+    case 'r':
+      ptr = l1_realloc(objects[ev->id], ev->size);
+      break;
+    default:
+      l1_free(objects[ev->id]);
+      ptr = NULL;
+      break;
+    }
+    elapsed += now_ns() - start;
+
+    if (ev->op != 'f' && ptr == NULL) {
+      /* A failed realloc leaves the object as it was */
+      failed++;
+      continue;
+    }
+    live += ev->size - sizes[ev->id];
+    objects[ev->id] = ptr;
+    sizes[ev->id] = ev->size;
+    if (ptr != NULL)
+      touch(ptr, ev->size);
+    if (live > peak_live) {
+      peak_live = live;
+      if (allocator->fragmentation != NULL && i % 64 == 0)
+        fragmentation = allocator->fragmentation();
+    }
+  }
+
+  char frag[16] = "    -";
+  if (allocator->fragmentation != NULL)
+    snprintf(frag, sizeof(frag), "%.3f", fragmentation);
+  printf("%-6s %8.2f Mops/s  peak live %8zu KiB  footprint %8zu KiB  "
+         "fragmentation %s  failed %u\n", allocator->name,
+         trace->length * 1e3 / elapsed, peak_live >> 10,
+         proc_status_kb("VmHWM") - base, frag, failed);
+  for (unsigned id = 0; id < trace->ids; id++)
+    l1_free(objects[id]);
+  if (l1_deinit != NULL)
+    l1_deinit();
+  exit(0);
+}
+
+static void replay_all(const char *name, const trace_t *trace) {
+  printf("== %s: %zu events, %u objects\n", name, trace->length, trace->ids);
+  for (size_t i = 0; i < ALLOCATORS; i++)
+    replay(trace, &allocators[i]);
+}
+
+static const shape_t *find_shape(const char *name) {
+  for (size_t i = 0; i < SHAPES; i++)
+    if (strcmp(shapes[i].name, name) == 0)
+      return &shapes[i];
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  trace_t trace = { 0 };
+
+  srand(323);
+  if (argc < 2) {
+    for (size_t i = 0; i < SHAPES; i++) {
+      trace.length = trace.ids = 0;
+      shapes[i].generate(&trace, TRACE_DEFAULT_EVENTS);
+      replay_all(shapes[i].name, &trace);
+    }
+  } else if (strcmp(argv[1], "gen") == 0 && argc >= 3) {
+    const shape_t *shape = find_shape(argv[2]);
+    if (shape == NULL) {
+      fprintf(stderr, "Unknown trace shape %s\n", argv[2]);
+      return EXIT_FAILURE;
+    }
+    shape->generate(&trace, argc >= 4 ? strtoul(argv[3], NULL, 10)
+                                      : TRACE_DEFAULT_EVENTS);
+    printf("# %s trace\n", shape->name);
+    for (size_t i = 0; i < trace.length; i++) {
+      if (trace.events[i].op == 'f')
+        printf("f %u\n", trace.events[i].id);
+      else
+        printf("%c %u %zu\n", trace.events[i].op, trace.events[i].id,
+               trace.events[i].size);
+    }
+  } else if (find_shape(argv[1]) != NULL) {
+    find_shape(argv[1])->generate(&trace, TRACE_DEFAULT_EVENTS);
+    replay_all(argv[1], &trace);
+  } else if (trace_read(argv[1], &trace) == 0) {
+    replay_all(argv[1], &trace);
+  } else {
+    fprintf(stderr, "Usage: %s [churn|phased|mixed|<trace file>|"
+                    "gen <shape> [events]]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  free(trace.events);
+  return EXIT_SUCCESS;
+}
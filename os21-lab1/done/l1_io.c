@@ -0,0 +1,207 @@
+/**
+ * @file l1_io.c
+ * @brief Implementation of the I/O wrappers and of their epoll reactor
+ */
+#define _GNU_SOURCE // accept4
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include "l1_io.h"
+#include "preempt.h"
+#include "schedule.h"
+/* Last: errno.h turns `errno` into a macro, which the thread info structs
+ * use as a field name */
+#include <errno.h>
+
+#define IO_EVENTS 256
+
+/** Helper function:
+ * Puts `fd` in non-blocking mode if it is not already
+ */
+static int set_nonblocking(int fd) {
+  const int flags = fcntl(fd, F_GETFL);
+  if (flags < 0)
+    return -1;
+  if (flags & O_NONBLOCK)
+    return 0;
+  return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/** Helper function:
+ * Makes room for the waiters of `fd`
+ */
+static int io_reserve(l1_io_reactor *io, int fd) {
+  if (fd < io->nfds)
+    return 0;
+  int nfds = io->nfds ? io->nfds : 64;
+  while (nfds <= fd)
+    nfds *= 2;
+  l1_io_waiters *waiters = realloc(io->waiters, nfds * sizeof(l1_io_waiters));
+  if (waiters == NULL)
+    return -1;
+  memset(waiters + io->nfds, 0, (nfds - io->nfds) * sizeof(l1_io_waiters));
+  io->waiters = waiters;
+  io->nfds = nfds;
+  return 0;
+}
+
+/** Helper function:
+ * Asks epoll for one report of the events the waiters of `fd` want. The
+ * descriptor stays registered between waits, unless it was closed since.
+ */
+static int io_arm(l1_io_reactor *io, int fd) {
+  const l1_io_waiters *w = &io->waiters[fd];
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLONESHOT | (w->reader ? EPOLLIN : 0)
+                 | (w->writer ? EPOLLOUT : 0);
+  event.data.fd = fd;
+  if (epoll_ctl(io->epoll_fd, EPOLL_CTL_MOD, fd, &event) == 0)
+    return 0;
+  if (errno != ENOENT)
+    return -1;
+  return epoll_ctl(io->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+/** Helper function:
+ * Parks the running thread until `fd` is ready for `events`, EPOLLIN or
+ * EPOLLOUT. Returns -1 with errno set if it cannot wait.
+ */
+static int io_wait(int fd, uint32_t events) {
+  l1_preempt_disable();
+  l1_scheduler_info *sched = get_scheduler();
+  l1_io_reactor *io = &sched->io;
+  int ret = -1;
+
+  if (io->epoll_fd < 0) {
+    io->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (io->epoll_fd < 0)
+      goto out;
+  }
+  if (io_reserve(io, fd) != 0) {
+    errno = ENOMEM;
+    goto out;
+  }
+  l1_thread_info **slot = (events == EPOLLIN) ? &io->waiters[fd].reader
+                                              : &io->waiters[fd].writer;
+  if (*slot != NULL) {
+    errno = EBUSY;
+    goto out;
+  }
+  *slot = sched->current;
+  if (io_arm(io, fd) != 0) {
+    *slot = NULL;
+    goto out;
+  }
+
+  /* The scheduler puts the thread aside until l1_io_poll wakes it up */
+  sched->current->state = IO_WAIT;
+  io->waiting++;
+  yield(-1);
+  ret = 0;
+out:
+  l1_preempt_enable();
+  return ret;
+}
+
+ssize_t l1_read(int fd, void *buf, size_t count) {
+  if (set_nonblocking(fd) != 0)
+    return -1;
+  for (;;) {
+    const ssize_t n = read(fd, buf, count);
+    if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+      return n;
+    if (io_wait(fd, EPOLLIN) != 0)
+      return -1;
+  }
+}
+
+ssize_t l1_write(int fd, const void *buf, size_t count) {
+  if (set_nonblocking(fd) != 0)
+    return -1;
+  for (;;) {
+    const ssize_t n = write(fd, buf, count);
+    if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+      return n;
+    if (io_wait(fd, EPOLLOUT) != 0)
+      return -1;
+  }
+}
+
+int l1_accept(int fd, struct sockaddr *addr, socklen_t *addrlen) {
+  if (set_nonblocking(fd) != 0)
+    return -1;
+  for (;;) {
+    const int conn = accept4(fd, addr, addrlen, SOCK_NONBLOCK);
+    if (conn >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+      return conn;
+    if (io_wait(fd, EPOLLIN) != 0)
+      return -1;
+  }
+}
+
+int l1_connect(int fd, const struct sockaddr *addr, socklen_t addrlen) {
+  if (set_nonblocking(fd) != 0)
+    return -1;
+  if (connect(fd, addr, addrlen) == 0)
+    return 0;
+  if (errno != EINPROGRESS)
+    return -1;
+  /* The socket becomes writable once the connection is settled */
+  if (io_wait(fd, EPOLLOUT) != 0)
+    return -1;
+  int err = 0;
+  socklen_t len = sizeof(err);
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0)
+    return -1;
+  if (err != 0) {
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+int l1_io_poll(l1_io_reactor *io, int timeout_ms) {
+  struct epoll_event events[IO_EVENTS];
+  if (io->epoll_fd < 0)
+    return 0;
+  /* Interrupted by a preemption tick, the caller polls again later */
+  const int n = epoll_wait(io->epoll_fd, events, IO_EVENTS, timeout_ms);
+  int woken = 0;
+  for (int i = 0; i < n; i++) {
+    const int fd = events[i].data.fd;
+    const uint32_t ready = events[i].events;
+    l1_io_waiters *w = &io->waiters[fd];
+    /* Errors and hang-ups wake both sides, to fail in their calls */
+    if (w->reader != NULL && (ready & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+      wake_thread(w->reader);
+      w->reader = NULL;
+      woken++;
+    }
+    if (w->writer != NULL && (ready & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+      wake_thread(w->writer);
+      w->writer = NULL;
+      woken++;
+    }
+    /* The other side still waits: report the descriptor again */
+    if ((w->reader != NULL || w->writer != NULL) && io_arm(io, fd) != 0) {
+      perror("epoll_ctl");
+      exit(-1);
+    }
+  }
+  io->waiting -= woken;
+  return woken;
+}
+
+void l1_io_clear(l1_io_reactor *io) {
+  if (io->epoll_fd >= 0)
+    close(io->epoll_fd);
+  free(io->waiters);
+  io->epoll_fd = -1;
+  io->waiters = NULL;
+  io->nfds = 0;
+  io->waiting = 0;
+}
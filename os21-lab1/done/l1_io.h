@@ -0,0 +1,73 @@
+/**
+ * @file l1_io.h
+ * @brief Blocking I/O for the green threads over non-blocking descriptors
+ *
+ * The l1 threads share one OS thread, so a blocking system call stops them
+ * all. The wrappers below put the descriptor in non-blocking mode and, when
+ * the call would block, park the calling thread in the IO_WAIT state until
+ * epoll reports the descriptor ready. Meanwhile the other threads run;
+ * schedule() polls epoll on each decision while threads wait, and tsys
+ * blocks in epoll_wait when nothing else is runnable.
+ *
+ * They follow the calls they wrap: they return -1 and set errno on failure.
+ * At most one thread at a time may wait to read, and one to write, on a
+ * descriptor; others fail with EBUSY. A descriptor must not be closed while
+ * a thread waits on it.
+ */
+#pragma once
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "thread_info.h"
+
+/* Threads waiting on a descriptor */
+typedef struct {
+  l1_thread_info* reader;         /** Waiting to read or accept */
+  l1_thread_info* writer;         /** Waiting to write or connect */
+} l1_io_waiters;
+
+typedef struct {
+  int epoll_fd;                   /** -1 until a thread first waits */
+  l1_io_waiters* waiters;         /** Waiters of each descriptor, by fd */
+  int nfds;                       /** Number of entries in `waiters` */
+  size_t waiting;                 /** Number of threads in IO_WAIT */
+} l1_io_reactor;
+
+/**
+ * @brief Reads like read(2), leaving the CPU to other threads until `fd` is
+ * readable
+ */
+ssize_t l1_read(int fd, void *buf, size_t count);
+
+/**
+ * @brief Writes like write(2), leaving the CPU to other threads until `fd`
+ * is writable. Like write(2), it may write less than `count`.
+ */
+ssize_t l1_write(int fd, const void *buf, size_t count);
+
+/**
+ * @brief Accepts a connection like accept(2), leaving the CPU to other
+ * threads until one arrives. The new socket is non-blocking.
+ */
+int l1_accept(int fd, struct sockaddr *addr, socklen_t *addrlen);
+
+/**
+ * @brief Connects like connect(2), leaving the CPU to other threads until
+ * the connection is established or fails
+ */
+int l1_connect(int fd, const struct sockaddr *addr, socklen_t addrlen);
+
+/**
+ * @brief Wakes up the threads whose descriptors are ready
+ *
+ * Called by the scheduler. Waits for up to `timeout_ms` milliseconds, or
+ * not at all if it is 0, or until a descriptor is ready if it is -1.
+ *
+ * @return The number of threads woken up
+ */
+int l1_io_poll(l1_io_reactor *io, int timeout_ms);
+
+/**
+ * @brief Closes the epoll instance and frees the waiters
+ */
+void l1_io_clear(l1_io_reactor *io);
@@ -0,0 +1,289 @@
+/**
+ * @file l1_preload.c
+ * @brief Interposes the C allocation functions with the lab allocators
+ *
+ * Built as `l1_preload.so`, this runs unmodified binaries over the list or
+ * the chunk allocator:
+ *
+ *   LD_PRELOAD=./l1_preload.so L1_PRELOAD_ALLOCATOR=chunk sort big.txt
+ *
+ * `L1_PRELOAD_ALLOCATOR` selects `list` (the default) or `chunk`. Every call
+ * goes through one lock, so threaded programs are safe, if serialised.
+ *
+ * The allocator is set up on the first call. The setup itself allocates, and
+ * so may the dynamic loader before it; those requests are served from a
+ * static bootstrap buffer whose blocks are never reused.
+ */
+#define _GNU_SOURCE // PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "malloc.h"
+#include "error.h"
+
+#define BOOTSTRAP_SIZE (64 * 1024)
+
+/* Operations of the backing allocator */
+typedef struct {
+  void (*init)(void);
+  void *(*malloc)(size_t);
+  l1_error (*free)(void *);
+  void *(*realloc)(void *, size_t);
+  void *(*calloc)(size_t, size_t);
+  void *(*memalign)(size_t, size_t);
+  size_t (*usable)(void *);
+} preload_ops;
+
+static const preload_ops list_ops = {
+  l1_list_init, l1_list_malloc, l1_list_free, l1_list_realloc,
+  l1_list_calloc, l1_list_memalign, l1_list_usable_size,
+};
+
+static const preload_ops chunk_ops = {
+  l1_chunk_init, l1_chunk_malloc, l1_chunk_free, l1_chunk_realloc,
+  l1_chunk_calloc, l1_chunk_memalign, l1_chunk_usable_size,
+};
+
+static const preload_ops *ops;
+static int initializing;
+
+/* Recursive, so that allocations made while setting up find the lock taken
+ * by their own thread and fall back to the bootstrap buffer */
+static pthread_mutex_t preload_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+/* Bootstrap blocks are preceded by their size, in a max_align_t */
+static max_align_t bootstrap[BOOTSTRAP_SIZE / sizeof(max_align_t)];
+static size_t bootstrap_used;
+
+/** Helper function:
+ * Checks if `ptr` was served from the bootstrap buffer
+ */
+static int is_bootstrap(void *ptr)
+{
+  return (char *)ptr >= (char *)bootstrap
+         && (char *)ptr < (char *)bootstrap + sizeof(bootstrap);
+}
+
+/** Helper function:
+ * Bump-allocates `size` bytes aligned to `alignment` from the bootstrap buffer
+ */
+static void *bootstrap_malloc(size_t alignment, size_t size)
+{
+  const size_t hdr = sizeof(max_align_t);
+  if (alignment < hdr)
+    alignment = hdr;
+
+  const uintptr_t base = (uintptr_t)bootstrap;
+  const uintptr_t start = (base + bootstrap_used + hdr + alignment - 1)
+                          & ~(uintptr_t)(alignment - 1);
+  if (size > sizeof(bootstrap)
+      || start + size > base + sizeof(bootstrap))
+    return NULL;
+
+  *(size_t *)(start - hdr) = size;
+  bootstrap_used = start + size - base;
+  return (void *)start;
+}
+
+/** Helper function:
+ * Size of a bootstrap block
+ */
+static size_t bootstrap_usable(void *ptr)
+{
+  return *(size_t *)((char *)ptr - sizeof(max_align_t));
+}
+
+static void preload_fork_prepare(void)
+{
+  pthread_mutex_lock(&preload_lock);
+}
+
+static void preload_fork_parent(void)
+{
+  pthread_mutex_unlock(&preload_lock);
+}
+
+/* The child's only thread does not own the lock taken in the parent, so the
+ * lock is reset rather than released */
+static void preload_fork_child(void)
+{
+  pthread_mutex_t fresh = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+  preload_lock = fresh;
+}
+
+/** Helper function:
+ * Takes the lock, setting up the backing allocator on first use. Returns 0 if
+ * the caller must be served from the bootstrap buffer instead.
+ */
+static int preload_enter(void)
+{
+  pthread_mutex_lock(&preload_lock);
+  if (ops != NULL)
+    return 1;
+  if (initializing)
+    return 0;
+
+  initializing = 1;
+  const char *name = getenv("L1_PRELOAD_ALLOCATOR");
+  const preload_ops *selected =
+    (name != NULL && strcmp(name, "chunk") == 0) ? &chunk_ops : &list_ops;
+  selected->init();
+  /* A child forked while another thread allocates must not inherit the lock
+   * taken */
+  pthread_atfork(preload_fork_prepare, preload_fork_parent,
+                 preload_fork_child);
+  ops = selected;
+  initializing = 0;
+  return 1;
+}
+
+static void preload_leave(void)
+{
+  pthread_mutex_unlock(&preload_lock);
+}
+
+/** Helper function:
+ * Sets errno from `l1_errno` after a failed allocation
+ */
+static void *preload_result(void *ptr)
+{
+  if (ptr == NULL)
+    errno = (l1_errno == ERRINVAL) ? EINVAL : ENOMEM;
+  return ptr;
+}
+
+void *malloc(size_t size)
+{
+  void *ptr;
+  /* The lab allocators return NULL for 0 bytes; callers expect a block */
+  if (size == 0)
+    size = 1;
+  if (preload_enter())
+    ptr = ops->malloc(size);
+  else
+    ptr = bootstrap_malloc(0, size);
+  ptr = preload_result(ptr);
+  preload_leave();
+  return ptr;
+}
+
+void free(void *ptr)
+{
+  /* Bootstrap blocks are never reused; foreign pointers are ignored */
+  if (ptr == NULL || is_bootstrap(ptr))
+    return;
+  if (preload_enter())
+    ops->free(ptr);
+  preload_leave();
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+  void *ptr;
+  if (nmemb == 0 || size == 0)
+    nmemb = size = 1;
+  if (preload_enter()) {
+    ptr = ops->calloc(nmemb, size);
+  } else if (size != 0 && nmemb > SIZE_MAX / size) {
+    ptr = NULL;
+  } else {
+    /* The bootstrap buffer is static, hence already zeroed */
+    ptr = bootstrap_malloc(0, nmemb * size);
+  }
+  ptr = preload_result(ptr);
+  preload_leave();
+  return ptr;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+  void *moved;
+  if (ptr == NULL)
+    return malloc(size);
+
+  if (!preload_enter()) {
+    moved = bootstrap_malloc(0, size);
+  } else if (is_bootstrap(ptr)) {
+    moved = ops->malloc(size ? size : 1);
+  } else {
+    moved = preload_result(ops->realloc(ptr, size));
+    preload_leave();
+    return moved;
+  }
+
+  /* Blocks leaving the bootstrap buffer are copied out by hand */
+  if (moved != NULL && is_bootstrap(ptr)) {
+    const size_t old = bootstrap_usable(ptr);
+    memcpy(moved, ptr, old < size ? old : size);
+  }
+  moved = preload_result(moved);
+  preload_leave();
+  return moved;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+  void *ptr;
+  if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0)
+    return EINVAL;
+  if (size == 0)
+    size = 1;
+  if (preload_enter()) {
+    ptr = ops->memalign(alignment, size);
+  } else {
+    ptr = bootstrap_malloc(alignment, size);
+    if (ptr == NULL)
+      l1_errno = ERRNOMEM;
+  }
+  const int err = (ptr != NULL) ? 0
+                  : (l1_errno == ERRINVAL) ? EINVAL : ENOMEM;
+  preload_leave();
+  if (err == 0)
+    *memptr = ptr;
+  return err;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+  void *ptr = NULL;
+  /* Alignments below a pointer are met by any block */
+  if (alignment < sizeof(void *))
+    alignment = sizeof(void *);
+  const int err = posix_memalign(&ptr, alignment, size);
+  if (err != 0)
+    errno = err;
+  return ptr;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+  return aligned_alloc(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+  return aligned_alloc(sysconf(_SC_PAGESIZE), size);
+}
+
+void *pvalloc(size_t size)
+{
+  const size_t page = sysconf(_SC_PAGESIZE);
+  return aligned_alloc(page, (size + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+  size_t usable = 0;
+  if (ptr == NULL)
+    return 0;
+  if (is_bootstrap(ptr))
+    return bootstrap_usable(ptr);
+  if (preload_enter())
+    usable = ops->usable(ptr);
+  preload_leave();
+  return usable;
+}
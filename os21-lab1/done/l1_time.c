@@ -1,24 +1,115 @@
 /**
- * @brief Implementations for time in rdtsc and unix time
+ * @brief Implementations for time over unix time, the monotonic clock and
+ * the time-stamp counter
  *
  * @author Adrien Ghosn, Mark Sutherland
  */
+#include <cpuid.h>
 #include <time.h>
 #include "l1_time.h"
 
+/* Time spent calibrating the time-stamp counter */
+#define TSC_CALIBRATION (20 * L1_TIME_MS)
+
+static l1_clock clock_backend = L1_CLOCK_MONOTONIC;
+
+/* Conversion of the time-stamp counter: ns = ns_base + cycles * mult / 2^32,
+ * cycles counting from tsc_base */
+static struct {
+  uint64_t tsc_base;
+  l1_time ns_base;
+  uint64_t mult;
+} tsc;
+
+/** Helper function:
+ * Reads the time-stamp counter
+ */
+static inline uint64_t tsc_read(void) {
+  unsigned int lo, hi; 
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t)hi << 32) | lo;
+}
+
+/** Helper function:
+ * Reads CLOCK_MONOTONIC in nanoseconds
+ */
+static inline l1_time monotonic_read(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (l1_time)ts.tv_sec * L1_TIME_S + ts.tv_nsec;
+}
+
+/** Helper function:
+ * Checks that the time-stamp counter ticks at a constant rate, whatever the
+ * frequency and sleep state of the core
+ */
+static int tsc_is_invariant(void) {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+    return 0;
+  return (edx >> 8) & 1;
+}
+
+/** Helper function:
+ * Measures the time-stamp counter against CLOCK_MONOTONIC for
+ * TSC_CALIBRATION nanoseconds
+ */
+static void tsc_calibrate(void) {
+  const l1_time ns_start = monotonic_read();
+  const uint64_t tsc_start = tsc_read();
+  l1_time ns_end;
+  do {
+    ns_end = monotonic_read();
+  } while (ns_end - ns_start < TSC_CALIBRATION);
+  const uint64_t cycles = tsc_read() - tsc_start;
+
+  tsc.mult = (uint64_t)((double)(ns_end - ns_start) / cycles * 4294967296.0);
+  tsc.tsc_base = tsc_read();
+  tsc.ns_base = monotonic_read();
+}
+
+/** Helper function:
+ * Converts the time-stamp counter to nanoseconds. The cycles are split in
+ * halves so that the products fit in 64 bits.
+ */
+static inline l1_time tsc_to_ns(uint64_t now) {
+  const uint64_t cycles = now - tsc.tsc_base;
+  return tsc.ns_base + (cycles >> 32) * tsc.mult
+         + (((cycles & 0xffffffffu) * tsc.mult) >> 32);
+}
+
+l1_error l1_time_set_clock(l1_clock clock) {
+  if (clock == L1_CLOCK_TSC) {
+    if (!tsc_is_invariant())
+      return ERRINVAL;
+    tsc_calibrate();
+  } else if (clock != L1_CLOCK_UNIX && clock != L1_CLOCK_MONOTONIC) {
+    return ERRINVAL;
+  }
+  clock_backend = clock;
+  return SUCCESS;
+}
+
+l1_clock l1_time_get_clock(void) {
+  return clock_backend;
+}
 
 void l1_time_init(l1_time* t) {
   *t = 0;
 }
   
 void l1_time_get(l1_time* t) {
-#ifdef USE_UNIX_TIME
-    time(t);
-#else
-  unsigned int lo, hi; 
-  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
-  *t = ((uint64_t)hi << 32) | lo;
-#endif
+  switch (clock_backend) {
+  case L1_CLOCK_TSC:
+    *t = tsc_to_ns(tsc_read());
+    break;
+  case L1_CLOCK_UNIX:
+    *t = (l1_time)time(NULL) * L1_TIME_S;
+    break;
+  default:
+    *t = monotonic_read();
+    break;
+  }
 }
 
 void l1_time_diff(l1_time* result, l1_time end, l1_time start) {
@@ -1,20 +1,46 @@
 /**
  * @brief provides the definitions for real time in lab1.
  *
+ * Times are counted in nanoseconds. The clock behind them is chosen at run
+ * time with l1_time_set_clock(), and defaults to L1_CLOCK_MONOTONIC.
+ *
  * @author Adrien Ghosn, Mark Sutherland
  */
 #pragma once
 #include <stdint.h>
 #include <time.h>
+#include "error.h"
 
-#define USE_UNIX_TIME
-
-/* Definition of time type */
-#ifdef USE_UNIX_TIME
-typedef time_t l1_time;
-#else
+/* Definition of time type, in nanoseconds */
 typedef uint64_t l1_time;
-#endif
+
+#define L1_TIME_US ((l1_time)1000)
+#define L1_TIME_MS ((l1_time)1000 * L1_TIME_US)
+#define L1_TIME_S ((l1_time)1000 * L1_TIME_MS)
+
+/* Clock backends */
+typedef enum {
+  L1_CLOCK_UNIX,       /* time(), with one-second resolution */
+  L1_CLOCK_MONOTONIC,  /* clock_gettime(CLOCK_MONOTONIC), served by the vDSO */
+  L1_CLOCK_TSC,        /* Invariant time-stamp counter, calibrated on selection */
+} l1_clock;
+
+/**
+ * @brief selects the clock l1_time_get() reads
+ *
+ * Selecting L1_CLOCK_TSC calibrates the counter against CLOCK_MONOTONIC,
+ * which takes a few milliseconds. Times taken with different clocks must not
+ * be compared.
+ *
+ * @return ERRINVAL, keeping the current clock, if the CPU has no invariant
+ *         time-stamp counter
+ */
+l1_error l1_time_set_clock(l1_clock clock);
+
+/**
+ * @brief returns the clock l1_time_get() reads
+ */
+l1_clock l1_time_get_clock(void);
 
 /**
  * @brief initializes time variable
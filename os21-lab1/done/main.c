@@ -21,6 +21,9 @@ void *(*l1_malloc)(size_t) = libc_malloc;
 l1_error (*l1_free)(void *) = libc_free;
 void (*l1_init)(void) = NULL;
 void (*l1_deinit)(void) = NULL;
+void *(*l1_realloc)(void *, size_t) = libc_realloc;
+void *(*l1_calloc)(size_t, size_t) = libc_calloc;
+void *(*l1_memalign)(size_t, size_t) = libc_memalign;
 
 /* is_bar allocates and returns a bool.
  * The function checks if the argument is the string "bar"
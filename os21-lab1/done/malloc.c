@@ -4,11 +4,15 @@
  *
  * @author Atri Bhattacharyya, Ahmad Hazimeh
  */
+#define _GNU_SOURCE // mremap
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "malloc.h"
 #include "error.h"
 
@@ -22,36 +26,298 @@ l1_error libc_free(void *ptr) {
 
   return SUCCESS;
 }
+
+void *libc_realloc(void *ptr, size_t size) {
+  return realloc(ptr, size);
+}
+
+void *libc_calloc(size_t nmemb, size_t size) {
+  return calloc(nmemb, size);
+}
+
+void *libc_memalign(size_t alignment, size_t size) {
+  void *ptr;
+  return (posix_memalign(&ptr, alignment, size) == 0) ? ptr : NULL;
+}
+/**********************************************************/
+
+/*********************** Segments ************************/
+
+size_t l1_segment_size = ALLOC8R_HEAP_SIZE;
+
+/** Helper function:
+ * Size of a segment: `l1_segment_size` rounded up to whole pages, and at most
+ * the whole reservation
+ */
+static size_t segment_bytes(void)
+{
+  const size_t page = sysconf(_SC_PAGESIZE);
+  size_t bytes = (l1_segment_size + page - 1) / page * page;
+  if (bytes == 0)
+    bytes = page;
+  return (bytes < ALLOC8R_RESERVE_SIZE) ? bytes : ALLOC8R_RESERVE_SIZE;
+}
+
+/** Helper function:
+ * Reserves `size` bytes of address space. Nothing is backed by memory, nor
+ * accessible, until it is committed.
+ */
+static void *segment_reserve(size_t size)
+{
+  void *addr = mmap(NULL, size, PROT_NONE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return (addr == MAP_FAILED) ? NULL : addr;
+}
+
+/** Helper function:
+ * Makes `size` reserved bytes at `addr` readable and writable
+ */
+static int segment_commit(void *addr, size_t size)
+{
+  return mprotect(addr, size, PROT_READ | PROT_WRITE);
+}
+
+/** Helper function:
+ * Maps `count` zeroed elements of `size` bytes, backed lazily as they are
+ * written
+ */
+static void *table_map(size_t count, size_t size)
+{
+  void *addr = mmap(NULL, count * size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return (addr == MAP_FAILED) ? NULL : addr;
+}
+/**********************************************************/
+
+/*********************** Huge allocations *****************/
+
+size_t l1_mmap_threshold = ALLOC8R_MMAP_THRESHOLD;
+l1_mmap_hdr *l1_mmap_head = NULL;
+
+/** Helper function:
+ * Start of the mapping holding a header: the header starts the mapping, unless
+ * the data needed a larger alignment, in which case it sits at the end of the
+ * mapping's first page
+ */
+static char *mmap_base(l1_mmap_hdr *hdr)
+{
+  const size_t page = sysconf(_SC_PAGESIZE);
+  return (char *)((uintptr_t)hdr & ~(uintptr_t)(page - 1));
+}
+
+/** Helper function:
+ * Serves a request of more than `l1_mmap_threshold` bytes with a mapping of
+ * its own, with the data aligned to `alignment`, a power of two. The pages
+ * mapped only to reach the alignment are unmapped again.
+ */
+static void *mmap_malloc_aligned(size_t size, size_t alignment)
+{
+  const size_t page = sysconf(_SC_PAGESIZE);
+  if (alignment < sizeof(l1_mmap_hdr))
+    alignment = sizeof(l1_mmap_hdr);
+  if (size > SIZE_MAX - sizeof(l1_mmap_hdr) - alignment - page) {
+    l1_errno = ERRNOMEM;
+    return NULL;
+  }
+  const size_t length = (sizeof(l1_mmap_hdr) + alignment + size + page - 1)
+                        / page * page;
+  char *map = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+    l1_errno = ERRNOMEM;
+    return NULL;
+  }
+
+  /* Keep the pages from the header's one to the last one of the data */
+  char *data = (char *)(((uintptr_t)map + sizeof(l1_mmap_hdr) + alignment - 1)
+                        & ~(uintptr_t)(alignment - 1));
+  l1_mmap_hdr *hdr = (l1_mmap_hdr *)data - 1;
+  char *base = mmap_base(hdr);
+  char *end = (char *)(((uintptr_t)data + size + page - 1)
+                       & ~(uintptr_t)(page - 1));
+  if (base > map)
+    munmap(map, base - map);
+  if (end < map + length)
+    munmap(end, map + length - end);
+
+  hdr->length = end - base;
+  hdr->prev = NULL;
+  hdr->next = l1_mmap_head;
+  if (l1_mmap_head != NULL)
+    l1_mmap_head->prev = hdr;
+  l1_mmap_head = hdr;
+  return data;
+}
+
+/** Helper function:
+ * Serves a request of more than `l1_mmap_threshold` bytes with a mapping of
+ * its own
+ */
+static void *mmap_malloc(size_t size)
+{
+  return mmap_malloc_aligned(size, sizeof(max_align_t));
+}
+
+/** Helper function:
+ * Unmaps a huge allocation. Pointers that are not the data of a live mapping
+ * are rejected without being dereferenced.
+ */
+static l1_error mmap_free(void *ptr)
+{
+  l1_mmap_hdr *hdr = (l1_mmap_hdr *)ptr - 1;
+  l1_mmap_hdr *cur = l1_mmap_head;
+  while (cur != NULL && cur != hdr)
+    cur = cur->next;
+  if (cur == NULL)
+    return ERRINVAL;
+
+  if (hdr->prev != NULL)
+    hdr->prev->next = hdr->next;
+  else
+    l1_mmap_head = hdr->next;
+  if (hdr->next != NULL)
+    hdr->next->prev = hdr->prev;
+  munmap(mmap_base(hdr), hdr->length);
+  return SUCCESS;
+}
+
+/** Helper function:
+ * Usable size of a huge allocation, or 0 if `ptr` is not the data of a live
+ * mapping
+ */
+static size_t mmap_usable(void *ptr)
+{
+  l1_mmap_hdr *hdr = (l1_mmap_hdr *)ptr - 1;
+  for (l1_mmap_hdr *cur = l1_mmap_head; cur != NULL; cur = cur->next)
+    if (cur == hdr)
+      return mmap_base(hdr) + hdr->length - (char *)ptr;
+  return 0;
+}
+
+/** Helper function:
+ * Resizes the mapping of a live huge allocation to fit `size` bytes. The
+ * kernel moves the pages if the mapping cannot grow in place, without copying
+ * them. Alignments above the page size are not kept across a move.
+ */
+static void *mmap_resize(void *ptr, size_t size)
+{
+  l1_mmap_hdr *hdr = (l1_mmap_hdr *)ptr - 1;
+  char *base = mmap_base(hdr);
+  const size_t lead = (char *)ptr - base;
+  const size_t page = sysconf(_SC_PAGESIZE);
+  if (size > SIZE_MAX - lead - page) {
+    l1_errno = ERRNOMEM;
+    return NULL;
+  }
+  const size_t length = (lead + size + page - 1) / page * page;
+  char *moved = mremap(base, hdr->length, length, MREMAP_MAYMOVE);
+  if (moved == MAP_FAILED) {
+    l1_errno = ERRNOMEM;
+    return NULL;
+  }
+
+  hdr = (l1_mmap_hdr *)(moved + lead) - 1;
+  hdr->length = length;
+  if (hdr->prev != NULL)
+    hdr->prev->next = hdr;
+  else
+    l1_mmap_head = hdr;
+  if (hdr->next != NULL)
+    hdr->next->prev = hdr;
+  return hdr + 1;
+}
+
+/** Helper function:
+ * Whether `alignment` is a power of two, at least `sizeof(void *)`, or sets
+ * `l1_errno` to ERRINVAL
+ */
+static int alignment_valid(size_t alignment)
+{
+  if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) {
+    l1_errno = ERRINVAL;
+    return 0;
+  }
+  return 1;
+}
+
+/** Helper function:
+ * Number of bytes of `nmemb` elements of `size` bytes, or 0 and ERRNOMEM on
+ * overflow
+ */
+static size_t calloc_bytes(size_t nmemb, size_t size)
+{
+  if (size != 0 && nmemb > SIZE_MAX / size) {
+    l1_errno = ERRNOMEM;
+    return 0;
+  }
+  return nmemb * size;
+}
+
+/** Helper function:
+ * Unmaps the huge allocations that are still live
+ */
+static void mmap_free_all(void)
+{
+  while (l1_mmap_head != NULL)
+    mmap_free(l1_mmap_head + 1);
+}
 /**********************************************************/
 
 /*********************** Chunk malloc *********************/
 
 char (*l1_chunk_arena)[CHUNK_SIZE];
+size_t l1_chunk_arena_length;
 l1_chunk_desc_t *l1_chunk_meta;
+l1_region_hdr_t *l1_region_meta;
+l1_slab_desc_t *l1_slab_meta;
+l1_slab_desc_t *l1_slab_partial[SLAB_CLASSES];
 max_align_t l1_region_magic;
 
+/* Chunks per segment, and whether each segment may hold resident pages */
+static size_t chunk_segment_length;
+static uint8_t *chunk_segment_resident;
+
 void l1_chunk_init(void)
 {
-  /* Allocate chunk arena and metadata */
-  l1_chunk_arena = malloc(CHUNK_ARENA_LENGTH * CHUNK_SIZE);
-  l1_chunk_meta = malloc(CHUNK_ARENA_LENGTH * sizeof(l1_chunk_desc_t));
-  /* TODO: Allocate space for metadata */ 
-  if ((l1_chunk_arena == NULL) || (l1_chunk_meta == NULL)) {
-    printf("Unable to allocate %d bytes for the chunk allocator\n", ALLOC8R_HEAP_SIZE);
+  const size_t segments_max = CHUNK_RESERVE_LENGTH / (segment_bytes() / CHUNK_SIZE)
+                              + 1;
+
+  /* Reserve the chunk arena and metadata */
+  l1_chunk_arena = segment_reserve(ALLOC8R_RESERVE_SIZE);
+  l1_chunk_meta = table_map(CHUNK_META_LENGTH, sizeof(l1_chunk_desc_t));
+  l1_region_meta = table_map(CHUNK_RESERVE_LENGTH, sizeof(l1_region_hdr_t));
+  l1_slab_meta = table_map(CHUNK_RESERVE_LENGTH, sizeof(l1_slab_desc_t));
+  chunk_segment_resident = calloc(segments_max, sizeof(uint8_t));
+  if ((l1_chunk_arena == NULL) || (l1_chunk_meta == NULL)
+      || (l1_region_meta == NULL) || (l1_slab_meta == NULL)
+      || (chunk_segment_resident == NULL)
+      || segment_commit(l1_chunk_arena, segment_bytes()) != 0) {
+    printf("Unable to allocate %zu bytes for the chunk allocator\n", segment_bytes());
     exit(1);
   }
+  chunk_segment_length = segment_bytes() / CHUNK_SIZE;
+  l1_chunk_arena_length = chunk_segment_length;
 
   /* Generate random chunk magic */
   srand(time(NULL));
   for(unsigned i = 0; i < sizeof(max_align_t); ++i)
     *(((char *)&l1_region_magic) + i) = rand();
+
+  memset(l1_slab_partial, 0, sizeof(l1_slab_partial));
+#ifdef L1_ALLOC_STATS
+  l1_alloc_stats_reset(L1_CHUNK);
+#endif
 }
 
 void l1_chunk_deinit(void)
 {
   /* TODO: Cleanup */
-  free(l1_chunk_arena);
-  free(l1_chunk_meta);
+  munmap(l1_chunk_arena, ALLOC8R_RESERVE_SIZE);
+  munmap(l1_chunk_meta, CHUNK_META_LENGTH * sizeof(l1_chunk_desc_t));
+  munmap(l1_region_meta, CHUNK_RESERVE_LENGTH * sizeof(l1_region_hdr_t));
+  munmap(l1_slab_meta, CHUNK_RESERVE_LENGTH * sizeof(l1_slab_desc_t));
+  free(chunk_segment_resident);
+  mmap_free_all();
 }
 
 /** Helper function:
@@ -60,83 +326,327 @@ void l1_chunk_deinit(void)
 size_t chunk_count(size_t bytes)
 {
   return bytes / CHUNK_SIZE
-         + (bytes % CHUNK_SIZE != 0 ? 1 : 0) // ceil
-         + 1; // chunk for region_hdr_t
+         + (bytes % CHUNK_SIZE != 0 ? 1 : 0); // ceil
 }
 
 /** Helper function:
- * Create, initialize and copy the header chunk
+ * Initialize the side table entry of the region starting at `alloc_head`
  */
 void set_hdr_chunk(size_t alloc_head, size_t size)
 {
-  l1_region_hdr_t hdr;
-  hdr.magic0 = l1_region_magic;
-  hdr.size = size;
-  hdr.magic1 = l1_region_magic;
+  l1_region_hdr_t *hdr = &l1_region_meta[alloc_head];
+  hdr->magic0 = l1_region_magic;
+  hdr->size = size;
+  hdr->magic1 = l1_region_magic;
+}
 
-  memcpy((void *)l1_chunk_arena[alloc_head],
-         (void *)&hdr,
-         sizeof(l1_region_hdr_t));
+/** Helper function:
+ * Bitmap word `w`, with the bits of chunks past the end of the arena set so
+ * that they always look taken
+ */
+static l1_chunk_desc_t chunk_word(size_t w)
+{
+  l1_chunk_desc_t word = l1_chunk_meta[w];
+  const size_t valid = l1_chunk_arena_length - w * CHUNK_WORD_BITS;
+  if (valid < CHUNK_WORD_BITS)
+    word |= ~(l1_chunk_desc_t)0 << valid;
+  return word;
 }
 
 /** Helper function:
- * Checks that enough chunks are free, and if not tell position of last occupied
- * chunk
+ * Finds the first run of `len` free chunks, working a bitmap word at a time.
+ * `run` counts the free chunks carried over from the high end of previous
+ * words; runs that fit inside a single word are found by and-ing the free mask
+ * with shifted copies of itself, so that bit i survives iff chunks i to
+ * i + len - 1 are all free.
+ *
+ * Returns the index of the first chunk of the run, or -1 if there is none.
  */
-int verify_chunks_free(size_t start, size_t len, size_t *last_occupied)
+static long chunk_run_find(size_t len)
 {
-  int free = 1;
-  for (int i = start; i < start + len; i++) {
-    if (IS_CHUNK_TAKEN(i)) {
-      /* Not enough free chunks found */
-      free = 0;
-      *last_occupied = i;
-      break;
+  size_t run = 0, run_start = 0;
+  const size_t words = CHUNK_WORD(l1_chunk_arena_length - 1) + 1;
+
+  for (size_t w = 0; w < words; w++) {
+    const l1_chunk_desc_t word = chunk_word(w);
+    if (word == 0) {
+      /* Whole word free: extend the carried run */
+      if (run == 0)
+        run_start = w * CHUNK_WORD_BITS;
+      run += CHUNK_WORD_BITS;
+      if (run >= len)
+        return run_start;
+      continue;
+    }
+    /* Carried run continues into the low free bits of this word */
+    if (run + __builtin_ctzll(word) >= len)
+      return (run == 0) ? w * CHUNK_WORD_BITS : run_start;
+    /* Run lying entirely inside this word */
+    if (len < CHUNK_WORD_BITS) {
+      l1_chunk_desc_t fits = ~word;
+      for (size_t span = 1; span < len && fits != 0; ) {
+        const size_t step = (span < len - span) ? span : len - span;
+        fits &= fits >> step;
+        span += step;
+      }
+      if (fits != 0)
+        return w * CHUNK_WORD_BITS + __builtin_ctzll(fits);
     }
+    /* Free bits at the high end start a new carried run */
+    run = __builtin_clzll(word);
+    run_start = (w + 1) * CHUNK_WORD_BITS - run;
   }
-  return free;
+  return -1;
 }
 
-void *l1_chunk_malloc(size_t size)
+/** Helper function:
+ * Marks chunks [start, start + len) as taken or free, a whole word at a time
+ */
+static void chunk_run_mark(size_t start, size_t len, int taken)
+{
+  size_t end = start + len;
+
+  while (start < end) {
+    const size_t w = CHUNK_WORD(start);
+    const size_t lo = start % CHUNK_WORD_BITS;
+    const size_t hi = (end - w * CHUNK_WORD_BITS < CHUNK_WORD_BITS)
+                      ? end - w * CHUNK_WORD_BITS : CHUNK_WORD_BITS;
+    l1_chunk_desc_t mask = ~(l1_chunk_desc_t)0 << lo;
+    if (hi < CHUNK_WORD_BITS)
+      mask &= ~(~(l1_chunk_desc_t)0 << hi);
+
+    if (taken)
+      l1_chunk_meta[w] |= mask;
+    else
+      l1_chunk_meta[w] &= ~mask;
+    start = (w + 1) * CHUNK_WORD_BITS;
+  }
+}
+
+/** Helper function:
+ * Whether chunks [start, start + len) are all free
+ */
+static int chunk_run_is_free(size_t start, size_t len)
+{
+  for (size_t i = start; i < start + len; i++) {
+    if (i % CHUNK_WORD_BITS == 0 && i + CHUNK_WORD_BITS <= start + len) {
+      if (l1_chunk_meta[CHUNK_WORD(i)] != 0)
+        return 0;
+      i += CHUNK_WORD_BITS - 1;
+    } else if (IS_CHUNK_TAKEN(i)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/** Helper function:
+ * Maps new segments at the end of the arena, so that it ends with at least
+ * `len` free chunks. Returns 0 on success, -1 if the reservation is exhausted.
+ */
+static int chunk_grow(size_t len)
+{
+  /* Free chunks at the end of the arena count towards the run */
+  size_t tail = 0;
+  while (tail < len && tail < l1_chunk_arena_length
+         && IS_CHUNK_FREE(l1_chunk_arena_length - 1 - tail))
+    tail++;
+
+  const size_t segments = (len - tail + chunk_segment_length - 1)
+                          / chunk_segment_length;
+  size_t grow = segments * chunk_segment_length;
+  if (grow > CHUNK_RESERVE_LENGTH - l1_chunk_arena_length)
+    grow = CHUNK_RESERVE_LENGTH - l1_chunk_arena_length;
+  if (tail + grow < len
+      || segment_commit(l1_chunk_arena[l1_chunk_arena_length],
+                        grow * CHUNK_SIZE) != 0)
+    return -1;
+  l1_chunk_arena_length += grow;
+  return 0;
+}
+
+/** Helper function:
+ * Flags the segments overlapping chunks [start, start + len) as holding
+ * resident pages
+ */
+static void chunk_run_touch(size_t start, size_t len)
+{
+  for (size_t seg = start / chunk_segment_length;
+       seg * chunk_segment_length < start + len; seg++)
+    chunk_segment_resident[seg] = 1;
+}
+
+/** Helper function:
+ * Finds a run of `len` free chunks, growing the arena if there is none, and
+ * marks it taken. Returns the index of its first chunk, or -1.
+ */
+static long chunk_run_take(size_t len)
+{
+  long start = chunk_run_find(len);
+  if (start < 0) {
+    if (chunk_grow(len) != 0)
+      return -1;
+    start = chunk_run_find(len);
+  }
+  chunk_run_mark(start, len, 1);
+  chunk_run_touch(start, len);
+  return start;
+}
+
+/** Helper function:
+ * Marks chunks [start, start + len) free. Segments left without any taken
+ * chunk, except for the first one, give their pages back to the OS.
+ */
+static void chunk_run_release(size_t start, size_t len)
+{
+  chunk_run_mark(start, len, 0);
+  for (size_t seg = start / chunk_segment_length;
+       seg * chunk_segment_length < start + len; seg++) {
+    const size_t first = seg * chunk_segment_length;
+    const size_t seg_len = (first + chunk_segment_length <= l1_chunk_arena_length)
+                           ? chunk_segment_length : l1_chunk_arena_length - first;
+    if (seg == 0 || !chunk_segment_resident[seg]
+        || !chunk_run_is_free(first, seg_len))
+      continue;
+    madvise(l1_chunk_arena[first], seg_len * CHUNK_SIZE, MADV_DONTNEED);
+    chunk_segment_resident[seg] = 0;
+  }
+}
+
+/** Helper function:
+ * Size class index of a slab object fitting `size` bytes
+ */
+static unsigned slab_class(size_t size)
+{
+  if (size <= SLAB_MIN_SIZE)
+    return 0;
+  return CHUNK_WORD_BITS - __builtin_clzll(size - 1) - SLAB_MIN_SHIFT;
+}
+
+/** Helper function:
+ * Unlinks a slab from the partial list of its size class
+ */
+static void slab_list_remove(l1_slab_desc_t *slab)
+{
+  if (slab->prev != NULL)
+    slab->prev->next = slab->next;
+  else
+    l1_slab_partial[slab->size_class - 1] = slab->next;
+  if (slab->next != NULL)
+    slab->next->prev = slab->prev;
+  slab->prev = slab->next = NULL;
+}
+
+/** Helper function:
+ * Pushes a slab on the partial list of its size class
+ */
+static void slab_list_push(l1_slab_desc_t *slab)
+{
+  l1_slab_desc_t **head = &l1_slab_partial[slab->size_class - 1];
+  slab->prev = NULL;
+  slab->next = *head;
+  if (*head != NULL)
+    (*head)->prev = slab;
+  *head = slab;
+}
+
+/** Helper function:
+ * Takes a single chunk from the arena and sets it up as an empty slab of size
+ * class `cls`
+ */
+static l1_slab_desc_t *slab_new(unsigned cls)
+{
+  const long idx = chunk_run_take(1);
+  if (idx < 0)
+    return NULL;
+
+  l1_slab_desc_t *slab = &l1_slab_meta[idx];
+  const size_t objects = CHUNK_SIZE >> (cls + SLAB_MIN_SHIFT);
+  memset(slab, 0, sizeof(l1_slab_desc_t));
+  slab->size_class = cls + 1;
+  for (size_t w = 0; w * 64 < objects; w++)
+    slab->free_map[w] = (objects - w * 64 >= 64)
+                        ? ~(uint64_t)0 : ((uint64_t)1 << (objects - w * 64)) - 1;
+  slab_list_push(slab);
+  return slab;
+}
+
+/** Helper function:
+ * Allocates an object from the first partial slab of its size class
+ */
+static void *slab_malloc(size_t size)
+{
+  const unsigned cls = slab_class(size);
+  const unsigned shift = cls + SLAB_MIN_SHIFT;
+  l1_slab_desc_t *slab = l1_slab_partial[cls];
+
+  if (slab == NULL && (slab = slab_new(cls)) == NULL) {
+    l1_errno = ERRNOMEM;
+    return NULL;
+  }
+
+  size_t w = 0;
+  while (slab->free_map[w] == 0)
+    w++;
+  const size_t obj = w * 64 + __builtin_ctzll(slab->free_map[w]);
+  slab->free_map[w] &= slab->free_map[w] - 1;
+  if (++slab->used == CHUNK_SIZE >> shift)
+    slab_list_remove(slab);
+
+  return l1_chunk_arena[slab - l1_slab_meta] + (obj << shift);
+}
+
+/** Helper function:
+ * Returns the object at `offset` in a slab. Empty slabs go back to the arena
+ * unless no other slab of the class has free objects.
+ */
+static l1_error slab_free(l1_slab_desc_t *slab, size_t offset)
+{
+  const unsigned shift = slab->size_class - 1 + SLAB_MIN_SHIFT;
+  const size_t obj = offset >> shift;
+  const uint64_t bit = (uint64_t)1 << (obj % 64);
+
+  /* Not an object boundary, or the object is already free */
+  if ((offset & ((1 << shift) - 1)) != 0 || (slab->free_map[obj / 64] & bit))
+    return ERRINVAL;
+
+  slab->free_map[obj / 64] |= bit;
+  if (slab->used-- == CHUNK_SIZE >> shift)
+    slab_list_push(slab);
+  if (slab->used == 0 && (slab->prev != NULL || slab->next != NULL)) {
+    slab_list_remove(slab);
+    slab->size_class = 0;
+    chunk_run_release(slab - l1_slab_meta, 1);
+  }
+  return SUCCESS;
+}
+
+static void *chunk_malloc(size_t size)
 {
   if (size == 0)
     return NULL;
 
+  /* Small requests share a chunk with objects of the same size class */
+  if (size <= SLAB_MAX_SIZE)
+    return slab_malloc(size);
+
   /* TODO: Implement your function here */
-  /* Corner case: requested size larger than heap size */
-  if (size > ALLOC8R_HEAP_SIZE) {
+  /* Huge requests get a mapping of their own */
+  if (size > l1_mmap_threshold)
+    return mmap_malloc(size);
+  /* Corner case: requested size larger than the whole reservation */
+  if (size > ALLOC8R_RESERVE_SIZE) {
     l1_errno = ERRNOMEM;
     return NULL;
   }
 
-  /* Calculate requested size in chunks */
+  /* Calculate requested size in chunks, and take them */
   const size_t req_chunk_cnt = chunk_count(size);
-  /* Initialize variables for search loop */
-  int allocable = 0;
-  size_t alloc_head = 0;
-  // highest possible chunk number for request
-  size_t chunk_bound = CHUNK_ARENA_LENGTH - req_chunk_cnt + 1;
-
-  while (!allocable && alloc_head < chunk_bound) {
-    if (IS_CHUNK_FREE(alloc_head)) {
-      size_t last_occupied;
-      if (verify_chunks_free(alloc_head, req_chunk_cnt, &last_occupied)) {
-        allocable = 1;
-      } else {
-        /* Not enough contiguous chunks available, so jump last occupied chunk*/
-        alloc_head = last_occupied + 1;
-      }
-    } else {
-      alloc_head++;
-    }
-  }
+  const long alloc_head = chunk_run_take(req_chunk_cnt);
 
-  if (allocable) {
-    /* Set to be allocated chunks to taken */
-    for (int i = alloc_head; i < alloc_head + req_chunk_cnt; i++)
-      SET_CHUNK_TAKEN(i);
+  if (alloc_head >= 0) {
     set_hdr_chunk(alloc_head, size);
-    return &(l1_chunk_arena[alloc_head + 1]);
+    return &(l1_chunk_arena[alloc_head]);
   } else {
     l1_errno = ERRNOMEM;
     return NULL;
@@ -152,157 +662,1255 @@ int magic_equals(max_align_t *magic0, max_align_t *magic1)
   return equals; 
 }
 
-l1_error l1_chunk_free(void *ptr)
+static l1_error chunk_free(void *ptr)
 {
   if (ptr == NULL)
       return SUCCESS;
 
   /* TODO: Implement your function here */
   /* Corner case: to freed memory is outside of l1_chunk_arena */
-  if (ptr < (void *)l1_chunk_arena)
+  if (ptr < (void *)l1_chunk_arena
+      || ptr >= (void *)(l1_chunk_arena + l1_chunk_arena_length))
+    return mmap_free(ptr);
+
+  /* Objects inside a slab go back to their slab */
+  const size_t idx = ((char *)ptr - (char *)l1_chunk_arena) / CHUNK_SIZE;
+  const size_t obj_offset = (char *)ptr - l1_chunk_arena[idx];
+  if (l1_slab_meta[idx].size_class != 0)
+    return slab_free(&l1_slab_meta[idx], obj_offset);
+  if (obj_offset != 0)
     return ERRINVAL;
 
-  /* Get header chunk */
-  l1_region_hdr_t hdr;
-  // Cast ptr to 
-  char (*chunks)[CHUNK_SIZE] = ptr;
-  char (*header_chunk)[CHUNK_SIZE] = &(chunks[-1]);
-  memcpy(&hdr, header_chunk, sizeof(l1_region_hdr_t));
+  /* Get region header from the side table */
+  l1_region_hdr_t *hdr = &l1_region_meta[idx];
 
   /* Check if header is corrupted */
-  if (magic_equals(&hdr.magic0, &l1_region_magic)
+  if (magic_equals(&hdr->magic0, &l1_region_magic)
       && 
-      magic_equals(&hdr.magic1, &l1_region_magic)) 
+      magic_equals(&hdr->magic1, &l1_region_magic)) 
   {
     /* Free allocated chunks */
-    size_t offset = (header_chunk - l1_chunk_arena);
-    size_t chunk_size = chunk_count(hdr.size); // Amount of chunks to be freed
-    for (size_t i = 0; i < chunk_size; i++)
-      SET_CHUNK_FREE(offset + i);
+    size_t chunk_size = chunk_count(hdr->size); // Amount of chunks to be freed
+    chunk_run_release(idx, chunk_size);
+    memset(hdr, 0, sizeof(l1_region_hdr_t));
     return SUCCESS;
   } else {
     return ERRINVAL;
   }
 }
-/**********************************************************/
 
-/****************** Free list based malloc ****************/
-l1_list_meta *l1_list_free_head = NULL;
-void *l1_list_heap = NULL;
-max_align_t l1_list_magic;
+/** Helper function:
+ * Resizes the region of `old_cnt` chunks starting at `idx` to `new_cnt`
+ * chunks without moving it. Returns 0 on success, -1 if the chunks following
+ * it are not free.
+ */
+static int chunk_region_resize(size_t idx, size_t old_cnt, size_t new_cnt)
+{
+  if (new_cnt <= old_cnt) {
+    if (new_cnt < old_cnt)
+      chunk_run_release(idx + new_cnt, old_cnt - new_cnt);
+    return 0;
+  }
 
-void l1_list_init() {
-  l1_list_heap = malloc(ALLOC8R_HEAP_SIZE);
-  if(l1_list_heap == NULL) {
-    printf("Unable to allocate %d bytes for the list\n", ALLOC8R_HEAP_SIZE);
-    exit(1);
+  /* The region may grow past the end of the arena if nothing follows it */
+  const size_t end = idx + old_cnt;
+  const size_t avail = (end < l1_chunk_arena_length)
+                       ? l1_chunk_arena_length - end : 0;
+  const size_t check = (new_cnt - old_cnt < avail) ? new_cnt - old_cnt : avail;
+  if (!chunk_run_is_free(end, check))
+    return -1;
+  if (check < new_cnt - old_cnt && chunk_grow(new_cnt - old_cnt) != 0)
+    return -1;
+  chunk_run_mark(end, new_cnt - old_cnt, 1);
+  chunk_run_touch(end, new_cnt - old_cnt);
+  return 0;
+}
+
+static void *chunk_realloc(void *ptr, size_t size)
+{
+  if (ptr == NULL)
+    return chunk_malloc(size);
+  if (size == 0) {
+    chunk_free(ptr);
+    return NULL;
   }
 
-  /* Generate random list magic */
-  srand(time(NULL));
-  for(unsigned i = 0; i < sizeof(max_align_t); i++)
-    *(((char *)&l1_list_magic) + i) = rand();
+  size_t usable;
+  if (ptr < (void *)l1_chunk_arena
+      || ptr >= (void *)(l1_chunk_arena + l1_chunk_arena_length)) {
+    /* Huge allocation */
+    usable = mmap_usable(ptr);
+    if (usable == 0) {
+      l1_errno = ERRINVAL;
+      return NULL;
+    }
+    if (size > l1_mmap_threshold)
+      return mmap_resize(ptr, size);
+  } else {
+    const size_t idx = ((char *)ptr - (char *)l1_chunk_arena) / CHUNK_SIZE;
+    const size_t obj_offset = (char *)ptr - l1_chunk_arena[idx];
+    l1_slab_desc_t *slab = &l1_slab_meta[idx];
+    l1_region_hdr_t *hdr = &l1_region_meta[idx];
 
-  /* TODO: Complete metadata setup */
-  l1_list_meta initial_meta;
-  initial_meta.capacity = ALLOC8R_HEAP_SIZE - offsetof(l1_list_meta, next);
-  initial_meta.magic0 = l1_list_magic;
-  initial_meta.magic1 = l1_list_magic;
-  initial_meta.next = NULL;
-  memcpy(l1_list_heap, &initial_meta, sizeof(l1_list_meta));
-  l1_list_free_head = l1_list_heap;
-}
+    if (slab->size_class != 0) {
+      /* Slab object: stays while it fits its size class */
+      const unsigned shift = slab->size_class - 1 + SLAB_MIN_SHIFT;
+      const size_t obj = obj_offset >> shift;
+      if ((obj_offset & ((1 << shift) - 1)) != 0
+          || (slab->free_map[obj / 64] & ((uint64_t)1 << (obj % 64)))) {
+        l1_errno = ERRINVAL;
+        return NULL;
+      }
+      usable = (size_t)1 << shift;
+      if (size <= usable)
+        return ptr;
+    } else {
+      if (obj_offset != 0 || !magic_equals(&hdr->magic0, &l1_region_magic)
+          || !magic_equals(&hdr->magic1, &l1_region_magic)) {
+        l1_errno = ERRINVAL;
+        return NULL;
+      }
+      usable = hdr->size;
+      /* Regions stay regions, unless they become huge */
+      if (size <= l1_mmap_threshold
+          && chunk_region_resize(idx, chunk_count(hdr->size),
+                                 chunk_count(size)) == 0) {
+        hdr->size = size;
+        return ptr;
+      }
+    }
+  }
 
-void l1_list_deinit() {
-  /* TODO: Cleanup */
-  free(l1_list_heap);
+  void *moved = chunk_malloc(size);
+  if (moved == NULL)
+    return NULL;
+  memcpy(moved, ptr, (usable < size) ? usable : size);
+  chunk_free(ptr);
+  return moved;
 }
 
 /** Helper function:
- * Change region from free to reserved by rewiring previous next to current next
+ * Finds the first run of `len` free chunks whose address is a multiple of
+ * `alignment`, a multiple of `CHUNK_SIZE`. Returns the index of its first
+ * chunk, or -1.
  */
-void update_list(l1_list_meta *prev, l1_list_meta *cur, l1_list_meta *new_meta)
+static long chunk_run_find_aligned(size_t len, size_t alignment)
 {
-  if (cur == l1_list_free_head) {
-    l1_list_free_head = new_meta;
-  } else {
-    prev->next = new_meta;
-  }
+  const size_t step = alignment / CHUNK_SIZE;
+  const uintptr_t arena = (uintptr_t)l1_chunk_arena;
+  size_t idx = (((arena + alignment - 1) & ~(uintptr_t)(alignment - 1)) - arena)
+               / CHUNK_SIZE;
+
+  for (; idx + len <= l1_chunk_arena_length; idx += step)
+    if (chunk_run_is_free(idx, len))
+      return idx;
+  return -1;
 }
 
-void *l1_list_malloc(size_t req_size) {
-  if(req_size == 0)
-    return NULL;
-  /* Corner case: requested size larger than heap size */
-  if (req_size > ALLOC8R_HEAP_SIZE - offsetof(l1_list_meta, next)) {
-    l1_errno = ERRNOMEM;
+static void *chunk_memalign(size_t alignment, size_t size)
+{
+  if (!alignment_valid(alignment) || size == 0)
     return NULL;
-  }
+  if (size > l1_mmap_threshold)
+    return mmap_malloc_aligned(size, alignment);
 
-  /* TODO: Implement your function here */
-  /* Calculate requested size in chunks */
-  const size_t req_chunks_cnt = req_size / sizeof(max_align_t)
-                              + (req_size % sizeof(max_align_t) != 0 ? 1 : 0);
-                              // ceil
-  const size_t aligned_sz = req_chunks_cnt * sizeof(max_align_t);
-  /* Traverse through free list until a chunk is big enough */
-  l1_list_meta *cur = l1_list_free_head;
-  l1_list_meta *prev = NULL;
-  while (cur != NULL && cur->capacity < aligned_sz) {
-    prev = cur;
-    cur = cur->next;
+  /* Slab objects are aligned to their size class, chunks to CHUNK_SIZE */
+  if (alignment <= SLAB_MAX_SIZE && size <= SLAB_MAX_SIZE)
+    return slab_malloc(size < alignment ? alignment : size);
+  if (alignment <= CHUNK_SIZE)
+    return chunk_malloc(size < SLAB_MAX_SIZE + 1 ? SLAB_MAX_SIZE + 1 : size);
+
+  const size_t req_chunk_cnt = chunk_count(size);
+  long alloc_head = chunk_run_find_aligned(req_chunk_cnt, alignment);
+  if (alloc_head < 0) {
+    /* A free tail this long holds an aligned run */
+    if (chunk_grow(req_chunk_cnt + alignment / CHUNK_SIZE - 1) != 0) {
+      l1_errno = ERRNOMEM;
+      return NULL;
+    }
+    alloc_head = chunk_run_find_aligned(req_chunk_cnt, alignment);
   }
-  /* First-fit failed */
+  chunk_run_mark(alloc_head, req_chunk_cnt, 1);
+  chunk_run_touch(alloc_head, req_chunk_cnt);
+  set_hdr_chunk(alloc_head, size);
+  return &(l1_chunk_arena[alloc_head]);
+}
+
+static void *chunk_calloc(size_t nmemb, size_t size)
+{
+  const size_t bytes = calloc_bytes(nmemb, size);
+  if (bytes == 0)
+    return NULL;
+  /* Fresh mappings are already zeroed */
+  if (bytes > l1_mmap_threshold)
+    return mmap_malloc(bytes);
+
+  void *ptr = chunk_malloc(bytes);
+  if (ptr != NULL)
+    memset(ptr, 0, bytes);
+  return ptr;
+}
+
+size_t l1_chunk_usable_size(void *ptr)
+{
+  if (ptr == NULL)
+    return 0;
+  if (ptr < (void *)l1_chunk_arena
+      || ptr >= (void *)(l1_chunk_arena + l1_chunk_arena_length))
+    return mmap_usable(ptr);
+  const size_t idx = ((char *)ptr - (char *)l1_chunk_arena) / CHUNK_SIZE;
+  if (l1_slab_meta[idx].size_class != 0)
+    return (size_t)1 << (l1_slab_meta[idx].size_class - 1 + SLAB_MIN_SHIFT);
+  return chunk_count(l1_region_meta[idx].size) * CHUNK_SIZE;
+}
+/**********************************************************/
+
+/*********************** Buddy malloc *********************/
+_Static_assert((BUDDY_MIN_SIZE << BUDDY_MAX_ORDER) == ALLOC8R_HEAP_SIZE,
+               "The buddy orders must cover the whole arena");
+
+uint8_t *l1_buddy_meta;
+l1_buddy_block *l1_buddy_free_lists[BUDDY_MAX_ORDER + 1];
+uint32_t l1_buddy_orders;
+
+/** Helper function:
+ * Address of the block starting at `unit`
+ */
+static l1_buddy_block *buddy_block(size_t unit)
+{
+  return (l1_buddy_block *)((char *)l1_chunk_arena + (unit << BUDDY_MIN_SHIFT));
+}
+
+/** Helper function:
+ * Marks the block at `unit` free and pushes it on the list of its order
+ */
+static void buddy_push(size_t unit, unsigned order)
+{
+  l1_buddy_block *block = buddy_block(unit);
+  block->prev = NULL;
+  block->next = l1_buddy_free_lists[order];
+  if (block->next != NULL)
+    block->next->prev = block;
+  l1_buddy_free_lists[order] = block;
+  l1_buddy_orders |= 1u << order;
+  l1_buddy_meta[unit] = BUDDY_FREE | order;
+}
+
+/** Helper function:
+ * Unlinks the free block at `unit` from the list of its order
+ */
+static void buddy_remove(size_t unit, unsigned order)
+{
+  l1_buddy_block *block = buddy_block(unit);
+  if (block->prev != NULL)
+    block->prev->next = block->next;
+  else
+    l1_buddy_free_lists[order] = block->next;
+  if (block->next != NULL)
+    block->next->prev = block->prev;
+  if (l1_buddy_free_lists[order] == NULL)
+    l1_buddy_orders &= ~(1u << order);
+  l1_buddy_meta[unit] = 0;
+}
+
+void l1_buddy_init(void)
+{
+  l1_chunk_arena = aligned_alloc(ALLOC8R_HEAP_SIZE, ALLOC8R_HEAP_SIZE);
+  l1_buddy_meta = calloc(BUDDY_UNITS, sizeof(uint8_t));
+  if ((l1_chunk_arena == NULL) || (l1_buddy_meta == NULL)) {
+    printf("Unable to allocate %d bytes for the buddy allocator\n", ALLOC8R_HEAP_SIZE);
+    exit(1);
+  }
+
+  memset(l1_buddy_free_lists, 0, sizeof(l1_buddy_free_lists));
+  l1_buddy_orders = 0;
+  buddy_push(0, BUDDY_MAX_ORDER);
+}
+
+void l1_buddy_deinit(void)
+{
+  free(l1_chunk_arena);
+  free(l1_buddy_meta);
+}
+
+void *l1_buddy_malloc(size_t size)
+{
+  if (size == 0)
+    return NULL;
+  /* Corner case: requested size larger than heap size */
+  if (size > ALLOC8R_HEAP_SIZE) {
+    l1_errno = ERRNOMEM;
+    return NULL;
+  }
+
+  /* Smallest order fitting the request */
+  const unsigned order = (size <= BUDDY_MIN_SIZE) ? 0
+      : CHUNK_WORD_BITS - __builtin_clzll(size - 1) - BUDDY_MIN_SHIFT;
+  /* Smallest non-empty free list of at least that order */
+  const uint32_t candidates = l1_buddy_orders & (~0u << order);
+  if (candidates == 0) {
+    l1_errno = ERRNOMEM;
+    return NULL;
+  }
+  unsigned found = __builtin_ctz(candidates);
+  const size_t unit =
+      ((char *)l1_buddy_free_lists[found] - (char *)l1_chunk_arena)
+      >> BUDDY_MIN_SHIFT;
+  buddy_remove(unit, found);
+
+  /* Split, keeping the lower half and freeing the upper buddy */
+  while (found > order) {
+    found--;
+    buddy_push(unit + ((size_t)1 << found), found);
+  }
+  l1_buddy_meta[unit] = BUDDY_TAKEN | order;
+  return buddy_block(unit);
+}
+
+l1_error l1_buddy_free(void *ptr)
+{
+  if (ptr == NULL)
+    return SUCCESS;
+
+  const size_t offset = (char *)ptr - (char *)l1_chunk_arena;
+  if (ptr < (void *)l1_chunk_arena || offset >= ALLOC8R_HEAP_SIZE
+      || offset % BUDDY_MIN_SIZE != 0)
+    return ERRINVAL;
+  size_t unit = offset >> BUDDY_MIN_SHIFT;
+  if ((l1_buddy_meta[unit] & BUDDY_TAKEN) == 0)
+    return ERRINVAL;
+
+  /* Merge with the buddy as long as it is a free block of the same order */
+  unsigned order = l1_buddy_meta[unit] & BUDDY_ORDER_MASK;
+  l1_buddy_meta[unit] = 0;
+  while (order < BUDDY_MAX_ORDER) {
+    const size_t buddy = unit ^ ((size_t)1 << order);
+    if (l1_buddy_meta[buddy] != (BUDDY_FREE | order))
+      break;
+    buddy_remove(buddy, order);
+    unit &= ~((size_t)1 << order);
+    order++;
+  }
+  buddy_push(unit, order);
+  return SUCCESS;
+}
+/**********************************************************/
+
+/****************** Free list based malloc ****************/
+_Static_assert(LIST_BINS <= 64, "The bin map must fit in a word");
+
+l1_list_meta *l1_list_bins[LIST_BINS];
+uint64_t l1_list_bin_map;
+void *l1_list_heap = NULL;
+size_t l1_list_heap_size;
+max_align_t l1_list_magic;
+
+/* Bytes per segment, and whether each segment may hold resident pages */
+static size_t list_segment_size;
+static uint8_t *list_segment_resident;
+
+/** Helper function:
+ * Boundary tag of a region
+ */
+static l1_list_tag *list_tag(l1_list_meta *meta)
+{
+  return (l1_list_tag *)((char *)meta + LIST_HDR_SIZE + meta->capacity);
+}
+
+/** Helper function:
+ * Flags the segments overlapping [begin, end) as holding resident pages
+ */
+static void list_touch(char *begin, char *end)
+{
+  for (size_t seg = (begin - (char *)l1_list_heap) / list_segment_size;
+       seg * list_segment_size < (size_t)(end - (char *)l1_list_heap); seg++)
+    list_segment_resident[seg] = 1;
+}
+
+/** Helper function:
+ * Writes the header and boundary tag of a region, leaving the caller to flag
+ * their segments as resident
+ */
+static void list_write_region(l1_list_meta *meta, size_t capacity, size_t free)
+{
+  meta->magic0 = l1_list_magic;
+  meta->capacity = capacity;
+  meta->free = free;
+  meta->magic1 = l1_list_magic;
+  list_tag(meta)->capacity = capacity;
+  list_tag(meta)->free = free;
+}
+
+/** Helper function:
+ * Writes the header and boundary tag of a region
+ */
+static void list_set_region(l1_list_meta *meta, size_t capacity, size_t free)
+{
+  list_write_region(meta, capacity, free);
+  list_touch((char *)meta, (char *)meta + LIST_HDR_SIZE);
+  list_touch((char *)list_tag(meta), (char *)list_tag(meta) + LIST_TAG_SIZE);
+}
+
+/** Helper function:
+ * Bin of free regions with the given capacity
+ */
+static unsigned list_bin(size_t capacity)
+{
+  if (capacity <= LIST_FAST_MAX)
+    return capacity / sizeof(max_align_t) - 1;
+  return LIST_FAST_BINS + (63 - __builtin_clzll(capacity)) - LIST_FAST_SHIFT;
+}
+
+/** Helper function:
+ * Pushes a region on the head of the bin of its capacity
+ */
+static void list_push(l1_list_meta *meta)
+{
+  const unsigned bin = list_bin(meta->capacity);
+  meta->prev = NULL;
+  meta->next = l1_list_bins[bin];
+  if (meta->next != NULL)
+    meta->next->prev = meta;
+  l1_list_bins[bin] = meta;
+  l1_list_bin_map |= (uint64_t)1 << bin;
+}
+
+/** Helper function:
+ * Unlinks a region from its bin. Its capacity must not have changed since it
+ * was pushed.
+ */
+static void list_unlink(l1_list_meta *meta)
+{
+  const unsigned bin = list_bin(meta->capacity);
+  if (meta->prev != NULL)
+    meta->prev->next = meta->next;
+  else
+    l1_list_bins[bin] = meta->next;
+  if (meta->next != NULL)
+    meta->next->prev = meta->prev;
+  if (l1_list_bins[bin] == NULL)
+    l1_list_bin_map &= ~((uint64_t)1 << bin);
+}
+
+/** Helper function:
+ * Pops the head of the fast bin of exactly `aligned_sz` bytes, if any. This is
+ * the common case, so it skips the general lookup, unlinking and splitting.
+ */
+static l1_list_meta *list_pop_fast(size_t aligned_sz)
+{
+  const unsigned bin = aligned_sz / sizeof(max_align_t) - 1;
+  l1_list_meta *meta = l1_list_bins[bin];
+  if (meta == NULL)
+    return NULL;
+  l1_list_bins[bin] = meta->next;
+  if (meta->next != NULL)
+    meta->next->prev = NULL;
+  else
+    l1_list_bin_map &= ~((uint64_t)1 << bin);
+  return meta;
+}
+
+/** Helper function:
+ * Puts `meta` in place of `old` in the bin of `old`, which must also be the
+ * bin of `meta`
+ */
+static void list_replace(l1_list_meta *old, l1_list_meta *meta)
+{
+  meta->prev = old->prev;
+  meta->next = old->next;
+  if (meta->prev != NULL)
+    meta->prev->next = meta;
+  else
+    l1_list_bins[list_bin(old->capacity)] = meta;
+  if (meta->next != NULL)
+    meta->next->prev = meta;
+}
+
+/** Helper function:
+ * Finds a free region of at least `aligned_sz` bytes: an exact fit from a fast
+ * bin, else the best of the first few regions of the request's own bin, else
+ * the head of the smallest non-empty larger bin, in which every region fits.
+ */
+static l1_list_meta *list_find(size_t aligned_sz)
+{
+  const unsigned bin = list_bin(aligned_sz);
+
+  if (aligned_sz <= LIST_FAST_MAX) {
+    if (l1_list_bins[bin] != NULL)
+      return l1_list_bins[bin];
+  } else {
+    l1_list_meta *best = NULL;
+    unsigned scanned = 0;
+    for (l1_list_meta *cur = l1_list_bins[bin];
+         cur != NULL && scanned < LIST_BIN_SCAN; cur = cur->next, scanned++) {
+      if (cur->capacity >= aligned_sz
+          && (best == NULL || cur->capacity < best->capacity))
+        best = cur;
+    }
+    if (best != NULL)
+      return best;
+  }
+
+  const uint64_t larger = l1_list_bin_map & (~(uint64_t)1 << bin);
+  if (larger == 0)
+    return NULL;
+  return l1_list_bins[__builtin_ctzll(larger)];
+}
+
+/** Helper function:
+ * Puts a region back in the bins, merging it with its free neighbours, and
+ * gives the pages of segments lying entirely inside the data of the merged
+ * region back to the OS. Returns the merged region.
+ */
+static l1_list_meta *list_release(l1_list_meta *meta)
+{
+  char *heap_end = (char *)l1_list_heap + l1_list_heap_size;
+
+  /* Merge with the physically following region if it is free */
+  l1_list_meta *right = (l1_list_meta *)((char *)list_tag(meta) + LIST_TAG_SIZE);
+  if ((char *)right < heap_end && right->free) {
+    list_unlink(right);
+    meta->capacity += LIST_HDR_SIZE + right->capacity + LIST_TAG_SIZE;
+    memset(right, 0, LIST_HDR_SIZE);
+  }
+
+  /* Merge into the physically preceding region if it is free */
+  if ((void *)meta > l1_list_heap) {
+    l1_list_tag *left_tag = (l1_list_tag *)((char *)meta - LIST_TAG_SIZE);
+    if (left_tag->free) {
+      l1_list_meta *left = (l1_list_meta *)((char *)left_tag
+                                            - left_tag->capacity
+                                            - LIST_HDR_SIZE);
+      /* The merged region may belong to a different bin */
+      list_unlink(left);
+      left->capacity += LIST_TAG_SIZE + LIST_HDR_SIZE + meta->capacity;
+      memset(meta, 0, LIST_HDR_SIZE);
+      meta = left;
+    }
+  }
+
+  /* Insert region back in to the bins */
+  list_set_region(meta, meta->capacity, 1);
+  list_push(meta);
+
+  /* Skip the first segment, and the pages holding the header and tag */
+  const size_t data = (char *)meta + LIST_HDR_SIZE - (char *)l1_list_heap;
+  const size_t data_end = data + meta->capacity;
+  size_t seg = (data + list_segment_size - 1) / list_segment_size;
+  if (seg == 0)
+    seg = 1;
+  for (; (seg + 1) * list_segment_size <= data_end; seg++) {
+    if (!list_segment_resident[seg])
+      continue;
+    madvise((char *)l1_list_heap + seg * list_segment_size, list_segment_size,
+            MADV_DONTNEED);
+    list_segment_resident[seg] = 0;
+  }
+  return meta;
+}
+
+/** Helper function:
+ * Maps new segments at the end of the heap, so that its last region is a free
+ * one of at least `aligned_sz` bytes, and returns that region. Returns NULL if
+ * the reservation is exhausted.
+ */
+static l1_list_meta *list_grow(size_t aligned_sz)
+{
+  char *heap_end = (char *)l1_list_heap + l1_list_heap_size;
+  l1_list_tag *last = (l1_list_tag *)(heap_end - LIST_TAG_SIZE);
+
+  /* A free last region is extended; otherwise a new region is appended */
+  size_t need = LIST_HDR_SIZE + aligned_sz + LIST_TAG_SIZE;
+  if (last->free) {
+    l1_list_meta *meta = (l1_list_meta *)((char *)last - last->capacity
+                                          - LIST_HDR_SIZE);
+    /* It may fit already, past the bounded scan of its bin */
+    if (last->capacity >= aligned_sz)
+      return meta;
+    need = aligned_sz - last->capacity;
+  }
+  const size_t grow = (need + list_segment_size - 1) / list_segment_size
+                      * list_segment_size;
+  if (grow > ALLOC8R_RESERVE_SIZE - l1_list_heap_size
+      || segment_commit(heap_end, grow) != 0)
+    return NULL;
+  /* Read without the lock by the thread-safe allocator */
+  __atomic_store_n(&l1_list_heap_size, l1_list_heap_size + grow,
+                   __ATOMIC_RELEASE);
+
+  /* Append the new space as an allocated region, then release it */
+  l1_list_meta *meta = (l1_list_meta *)heap_end;
+  list_set_region(meta, grow - LIST_HDR_SIZE - LIST_TAG_SIZE, 0);
+  return list_release(meta);
+}
+
+void l1_list_init() {
+  list_segment_size = segment_bytes();
+  l1_list_heap = segment_reserve(ALLOC8R_RESERVE_SIZE);
+  list_segment_resident = calloc(ALLOC8R_RESERVE_SIZE / list_segment_size + 1,
+                                 sizeof(uint8_t));
+  if (l1_list_heap == NULL || list_segment_resident == NULL
+      || segment_commit(l1_list_heap, list_segment_size) != 0) {
+    printf("Unable to allocate %zu bytes for the list\n", list_segment_size);
+    exit(1);
+  }
+  l1_list_heap_size = list_segment_size;
+
+  /* Generate random list magic */
+  srand(time(NULL));
+  for(unsigned i = 0; i < sizeof(max_align_t); i++)
+    *(((char *)&l1_list_magic) + i) = rand();
+
+  /* TODO: Complete metadata setup */
+  memset(l1_list_bins, 0, sizeof(l1_list_bins));
+  l1_list_bin_map = 0;
+  list_set_region(l1_list_heap,
+                  l1_list_heap_size - LIST_HDR_SIZE - LIST_TAG_SIZE, 1);
+  list_push(l1_list_heap);
+#ifdef L1_ALLOC_STATS
+  l1_alloc_stats_reset(L1_LIST);
+#endif
+}
+
+void l1_list_deinit() {
+  /* TODO: Cleanup */
+  munmap(l1_list_heap, ALLOC8R_RESERVE_SIZE);
+  free(list_segment_resident);
+  mmap_free_all();
+}
+
+static void *list_malloc(size_t req_size) {
+  if(req_size == 0)
+    return NULL;
+  /* Huge requests get a mapping of their own */
+  if (req_size > l1_mmap_threshold)
+    return mmap_malloc(req_size);
+  /* Corner case: requested size larger than the whole reservation */
+  if (req_size > ALLOC8R_RESERVE_SIZE - LIST_HDR_SIZE - LIST_TAG_SIZE) {
+    l1_errno = ERRNOMEM;
+    return NULL;
+  }
+
+  /* TODO: Implement your function here */
+  /* Calculate requested size in chunks */
+  const size_t req_chunks_cnt = req_size / sizeof(max_align_t)
+                              + (req_size % sizeof(max_align_t) != 0 ? 1 : 0);
+                              // ceil
+  const size_t aligned_sz = req_chunks_cnt * sizeof(max_align_t);
+  /* An exact fit from a fast bin needs no splitting */
+  l1_list_meta *cur = NULL;
+  if (aligned_sz <= LIST_FAST_MAX)
+    cur = list_pop_fast(aligned_sz);
+  if (cur != NULL) {
+    list_write_region(cur, aligned_sz, 0);
+    list_touch((char *)cur, (char *)list_tag(cur) + LIST_TAG_SIZE);
+    cur->next = NULL;
+    return (void *)(((char *)cur) + LIST_HDR_SIZE);
+  }
+  /* Look up the bins for a region big enough, else grow the heap */
+  cur = list_find(aligned_sz);
   if (cur == NULL)
-    return NULL; 
+    cur = list_grow(aligned_sz);
+  if (cur == NULL) {
+    l1_errno = ERRNOMEM;
+    return NULL;
+  }
   /** Check if free region can be split a.k.a
    * chunk is big enough to be followed by another free region 
    */
   // minimum region size
-  const size_t min_reg_sz = sizeof(l1_list_meta) + sizeof(max_align_t);
+  const size_t min_reg_sz = LIST_HDR_SIZE + LIST_MIN_CAPACITY + LIST_TAG_SIZE;
   if (cur->capacity >= aligned_sz + min_reg_sz) {
-    /* new meta of new free region */
-    l1_list_meta free_meta;
-    free_meta.capacity = cur->capacity 
-                      - offsetof(l1_list_meta, next) // Metadata without next
-                      - aligned_sz; // Data
-    free_meta.magic0 = l1_list_magic;
-    free_meta.magic1 = l1_list_magic;
-    free_meta.next = cur->next;
-    /* Update reserved region capacity */
-    cur->capacity = aligned_sz;
-    /* Find position of new meta and copy */
+    /* Find position of new meta and carve the new free region */
     l1_list_meta *free_meta_pos =
-      (l1_list_meta *)(((char *)cur) + offsetof(l1_list_meta, next) + aligned_sz);
-    memcpy(free_meta_pos, &free_meta, sizeof(l1_list_meta));
-    update_list(prev, cur, free_meta_pos);
+      (l1_list_meta *)((char *)cur + LIST_HDR_SIZE + aligned_sz + LIST_TAG_SIZE);
+    const size_t rest = cur->capacity - aligned_sz - LIST_HDR_SIZE
+                        - LIST_TAG_SIZE;
+    list_write_region(free_meta_pos, rest, 1);
+    /* A remainder staying in the same bin takes the place of the region */
+    if (list_bin(rest) == list_bin(cur->capacity)) {
+      list_replace(cur, free_meta_pos);
+    } else {
+      list_unlink(cur);
+      list_push(free_meta_pos);
+    }
+    /* Update reserved region capacity */
+    list_write_region(cur, aligned_sz, 0);
+    /* The region runs up to the header of the remainder */
+    list_touch((char *)cur, (char *)free_meta_pos + LIST_HDR_SIZE);
+    list_touch((char *)list_tag(free_meta_pos),
+               (char *)list_tag(free_meta_pos) + LIST_TAG_SIZE);
   } else { // Free region does not need to be split
-    update_list(prev, cur, cur->next);
+    list_unlink(cur);
+    list_write_region(cur, cur->capacity, 0);
+    list_touch((char *)cur, (char *)list_tag(cur) + LIST_TAG_SIZE);
   }
 
   cur->next = NULL;
-  return (void *)(((char *)cur) + offsetof(l1_list_meta, next));
+  return (void *)(((char *)cur) + LIST_HDR_SIZE);
 }
 
-l1_error l1_list_free(void *ptr) {
+static l1_error list_free(void *ptr) {
   if(ptr == NULL)
     return SUCCESS;
 
   /* TODO: Implement your function here */
+  /* Corner case: pointer outside of the heap */
+  char *heap_end = (char *)l1_list_heap + l1_list_heap_size;
+  if ((char *)ptr < (char *)l1_list_heap
+      || (char *)ptr >= heap_end)
+    return mmap_free(ptr);
+  if ((char *)ptr < (char *)l1_list_heap + LIST_HDR_SIZE)
+    return ERRINVAL;
   /* Get metadata */
   l1_list_meta *metadata_ptr = 
-    (l1_list_meta *)(((char *)ptr) - offsetof(l1_list_meta, next));
-  /* Check if metadata is corrupted */
+    (l1_list_meta *)(((char *)ptr) - LIST_HDR_SIZE);
+  /* Check if metadata is corrupted, or the region already free */
   if (!magic_equals(&metadata_ptr->magic0, &l1_list_magic)
       ||
-      !magic_equals(&metadata_ptr->magic1, &l1_list_magic))
+      !magic_equals(&metadata_ptr->magic1, &l1_list_magic)
+      ||
+      metadata_ptr->free)
   {
     return ERRINVAL;
   } 
 
-  /* Insert region back in to free list */
-  metadata_ptr->next = l1_list_free_head;
-  l1_list_free_head = metadata_ptr;
-  
+  list_release(metadata_ptr);
+  return SUCCESS;
+}
+
+/** Helper function:
+ * Shrinks an allocated region to `aligned_sz` bytes if the rest can hold a
+ * region of its own, which is released
+ */
+static void list_shrink(l1_list_meta *meta, size_t aligned_sz)
+{
+  const size_t min_reg_sz = LIST_HDR_SIZE + LIST_MIN_CAPACITY + LIST_TAG_SIZE;
+  if (meta->capacity < aligned_sz + min_reg_sz)
+    return;
+
+  l1_list_meta *rest =
+    (l1_list_meta *)((char *)meta + LIST_HDR_SIZE + aligned_sz + LIST_TAG_SIZE);
+  list_set_region(rest, meta->capacity - aligned_sz - LIST_HDR_SIZE
+                        - LIST_TAG_SIZE, 0);
+  list_set_region(meta, aligned_sz, 0);
+  list_release(rest);
+}
+
+/** Helper function:
+ * Grows an allocated region to at least `aligned_sz` bytes by absorbing the
+ * free region following it, growing the heap first if that region, or the
+ * allocated one, ends the heap. Returns 0 on success, -1 otherwise.
+ */
+static int list_expand(l1_list_meta *meta, size_t aligned_sz)
+{
+  const size_t extra = aligned_sz - meta->capacity;
+  l1_list_meta *right = (l1_list_meta *)((char *)list_tag(meta) + LIST_TAG_SIZE);
+  char *heap_end = (char *)l1_list_heap + l1_list_heap_size;
+
+  const int right_free = (char *)right < heap_end && right->free;
+  const size_t avail = right_free
+                       ? LIST_HDR_SIZE + right->capacity + LIST_TAG_SIZE : 0;
+  if (avail < extra) {
+    const int ends_heap = (char *)right == heap_end
+        || (right_free && (char *)list_tag(right) + LIST_TAG_SIZE == heap_end);
+    /* Growing leaves a free region right after this one */
+    if (!ends_heap || list_grow(extra) == NULL)
+      return -1;
+  }
+
+  list_unlink(right);
+  list_set_region(meta, meta->capacity + LIST_HDR_SIZE + right->capacity
+                        + LIST_TAG_SIZE, 0);
+  memset(right, 0, LIST_HDR_SIZE);
+  list_shrink(meta, aligned_sz);
+  list_touch((char *)meta, (char *)list_tag(meta) + LIST_TAG_SIZE);
+  return 0;
+}
+
+static void *list_realloc(void *ptr, size_t req_size) {
+  if (ptr == NULL)
+    return list_malloc(req_size);
+  if (req_size == 0) {
+    list_free(ptr);
+    return NULL;
+  }
+
+  size_t usable;
+  if ((char *)ptr < (char *)l1_list_heap
+      || (char *)ptr >= (char *)l1_list_heap + l1_list_heap_size) {
+    /* Huge allocation */
+    usable = mmap_usable(ptr);
+    if (usable == 0) {
+      l1_errno = ERRINVAL;
+      return NULL;
+    }
+    if (req_size > l1_mmap_threshold)
+      return mmap_resize(ptr, req_size);
+  } else {
+    l1_list_meta *meta = (l1_list_meta *)((char *)ptr - LIST_HDR_SIZE);
+    if ((char *)ptr < (char *)l1_list_heap + LIST_HDR_SIZE
+        || !magic_equals(&meta->magic0, &l1_list_magic)
+        || !magic_equals(&meta->magic1, &l1_list_magic) || meta->free) {
+      l1_errno = ERRINVAL;
+      return NULL;
+    }
+    usable = meta->capacity;
+    const size_t aligned_sz = (req_size + sizeof(max_align_t) - 1)
+                              / sizeof(max_align_t) * sizeof(max_align_t);
+    /* Regions stay regions, unless they become huge */
+    if (req_size <= l1_mmap_threshold) {
+      if (aligned_sz <= meta->capacity) {
+        list_shrink(meta, aligned_sz);
+        return ptr;
+      }
+      if (list_expand(meta, aligned_sz) == 0)
+        return ptr;
+    }
+  }
+
+  void *moved = list_malloc(req_size);
+  if (moved == NULL)
+    return NULL;
+  memcpy(moved, ptr, (usable < req_size) ? usable : req_size);
+  list_free(ptr);
+  return moved;
+}
+
+static void *list_memalign(size_t alignment, size_t req_size) {
+  if (!alignment_valid(alignment) || req_size == 0)
+    return NULL;
+  if (alignment <= sizeof(max_align_t))
+    return list_malloc(req_size);
+  if (req_size > l1_mmap_threshold)
+    return mmap_malloc_aligned(req_size, alignment);
+
+  const size_t aligned_sz = (req_size + sizeof(max_align_t) - 1)
+                            / sizeof(max_align_t) * sizeof(max_align_t);
+  const size_t min_reg_sz = LIST_HDR_SIZE + LIST_MIN_CAPACITY + LIST_TAG_SIZE;
+  /* Room for the data, plus a leading gap that can hold a region */
+  const size_t worst_sz = aligned_sz + min_reg_sz + alignment;
+  l1_list_meta *cur = list_find(worst_sz);
+  if (cur == NULL)
+    cur = list_grow(worst_sz);
+  if (cur == NULL) {
+    l1_errno = ERRNOMEM;
+    return NULL;
+  }
+  list_unlink(cur);
+
+  /* A leading gap becomes a free region of its own */
+  uintptr_t data = (uintptr_t)cur + LIST_HDR_SIZE;
+  if ((data & (alignment - 1)) != 0) {
+    data = (data + min_reg_sz + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    l1_list_meta *meta = (l1_list_meta *)(data - LIST_HDR_SIZE);
+    const size_t gap = (char *)meta - (char *)cur;
+    list_set_region(meta, cur->capacity - gap, 0);
+    list_set_region(cur, gap - LIST_HDR_SIZE - LIST_TAG_SIZE, 1);
+    list_push(cur);
+    cur = meta;
+  } else {
+    list_set_region(cur, cur->capacity, 0);
+  }
+  list_shrink(cur, aligned_sz);
+  list_touch((char *)cur, (char *)list_tag(cur) + LIST_TAG_SIZE);
+
+  cur->next = NULL;
+  return (void *)data;
+}
+
+static void *list_calloc(size_t nmemb, size_t size) {
+  const size_t bytes = calloc_bytes(nmemb, size);
+  if (bytes == 0)
+    return NULL;
+  /* Fresh mappings are already zeroed */
+  if (bytes > l1_mmap_threshold)
+    return mmap_malloc(bytes);
+
+  void *ptr = list_malloc(bytes);
+  if (ptr != NULL)
+    memset(ptr, 0, bytes);
+  return ptr;
+}
+
+size_t l1_list_usable_size(void *ptr)
+{
+  if (ptr == NULL)
+    return 0;
+  if ((char *)ptr < (char *)l1_list_heap + LIST_HDR_SIZE
+      || (char *)ptr >= (char *)l1_list_heap + l1_list_heap_size)
+    return mmap_usable(ptr);
+  return ((l1_list_meta *)((char *)ptr - LIST_HDR_SIZE))->capacity;
+}
+/**********************************************************/
+
+/****************** Thread-safe malloc ********************/
+_Static_assert((MT_CACHE_MAX_SIZE >> MT_CACHE_MIN_SHIFT)
+               == 1 << (MT_CACHE_CLASSES - 1),
+               "The cache classes must end at MT_CACHE_MAX_SIZE");
+
+typedef struct mt_block {
+  struct mt_block *next;
+} mt_block;
+
+typedef struct {
+  unsigned generation;
+  unsigned count[MT_CACHE_CLASSES];
+  mt_block *head[MT_CACHE_CLASSES];
+} mt_cache;
+
+unsigned l1_mt_generation;
+static pthread_mutex_t mt_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t mt_cache_key;
+static pthread_once_t mt_cache_key_once = PTHREAD_ONCE_INIT;
+static __thread mt_cache mt_thread_cache;
+
+/** Helper function:
+ * Gives the first `count` blocks of a cache class back to the central heap.
+ * The lock must be held.
+ */
+static void mt_cache_drain(mt_cache *cache, unsigned cls, unsigned count)
+{
+  while (count-- > 0 && cache->head[cls] != NULL) {
+    mt_block *block = cache->head[cls];
+    cache->head[cls] = block->next;
+    cache->count[cls]--;
+    l1_list_free(block);
+  }
+}
+
+/** Helper function:
+ * Thread exit destructor: flushes the caches of the exiting thread, unless
+ * they belong to an earlier heap
+ */
+static void mt_cache_flush(void *arg)
+{
+  mt_cache *cache = arg;
+  pthread_mutex_lock(&mt_lock);
+  if (cache->generation == l1_mt_generation)
+    for (unsigned cls = 0; cls < MT_CACHE_CLASSES; cls++)
+      mt_cache_drain(cache, cls, cache->count[cls]);
+  pthread_mutex_unlock(&mt_lock);
+}
+
+static void mt_cache_key_create(void)
+{
+  pthread_key_create(&mt_cache_key, mt_cache_flush);
+}
+
+/** Helper function:
+ * Caches of the calling thread, emptied if they belong to an earlier heap
+ */
+static mt_cache *mt_cache_get(void)
+{
+  mt_cache *cache = &mt_thread_cache;
+  if (cache->generation != l1_mt_generation) {
+    memset(cache, 0, sizeof(mt_cache));
+    cache->generation = l1_mt_generation;
+    pthread_setspecific(mt_cache_key, cache);
+  }
+  return cache;
+}
+
+void l1_mt_init(void)
+{
+  pthread_once(&mt_cache_key_once, mt_cache_key_create);
+  pthread_mutex_lock(&mt_lock);
+  l1_list_init();
+  l1_mt_generation++;
+  pthread_mutex_unlock(&mt_lock);
+}
+
+void l1_mt_deinit(void)
+{
+  pthread_mutex_lock(&mt_lock);
+  l1_list_deinit();
+  l1_mt_generation++;
+  pthread_mutex_unlock(&mt_lock);
+}
+
+void *l1_mt_malloc(size_t size)
+{
+  if (size == 0)
+    return NULL;
+
+  if (size > MT_CACHE_MAX_SIZE) {
+    pthread_mutex_lock(&mt_lock);
+    void *ptr = l1_list_malloc(size);
+    pthread_mutex_unlock(&mt_lock);
+    return ptr;
+  }
+
+  const unsigned cls = (size <= (1 << MT_CACHE_MIN_SHIFT)) ? 0
+      : CHUNK_WORD_BITS - __builtin_clzll(size - 1) - MT_CACHE_MIN_SHIFT;
+  mt_cache *cache = mt_cache_get();
+  if (cache->head[cls] == NULL) {
+    /* Refill a batch of blocks of the class at once */
+    pthread_mutex_lock(&mt_lock);
+    for (unsigned i = 0; i < MT_CACHE_BATCH; i++) {
+      mt_block *block = l1_list_malloc((size_t)1 << (cls + MT_CACHE_MIN_SHIFT));
+      if (block == NULL)
+        break;
+      block->next = cache->head[cls];
+      cache->head[cls] = block;
+      cache->count[cls]++;
+    }
+    pthread_mutex_unlock(&mt_lock);
+    if (cache->head[cls] == NULL)
+      return NULL;
+  }
+
+  mt_block *block = cache->head[cls];
+  cache->head[cls] = block->next;
+  cache->count[cls]--;
+  return block;
+}
+
+l1_error l1_mt_free(void *ptr)
+{
+  if (ptr == NULL)
+    return SUCCESS;
+
+  /* A block owned by the caller has a header no other thread writes to */
+  const size_t heap_size = __atomic_load_n(&l1_list_heap_size, __ATOMIC_ACQUIRE);
+  l1_list_meta *meta = (l1_list_meta *)((char *)ptr - LIST_HDR_SIZE);
+  if ((char *)ptr >= (char *)l1_list_heap + LIST_HDR_SIZE
+      && (char *)ptr < (char *)l1_list_heap + heap_size
+      && magic_equals(&meta->magic0, &l1_list_magic)
+      && magic_equals(&meta->magic1, &l1_list_magic) && !meta->free) {
+    /* Largest class the block fits in */
+    const unsigned cls = 63 - __builtin_clzll(meta->capacity)
+                         - MT_CACHE_MIN_SHIFT;
+    if (cls < MT_CACHE_CLASSES) {
+      mt_cache *cache = mt_cache_get();
+      mt_block *block = ptr;
+      block->next = cache->head[cls];
+      cache->head[cls] = block;
+      if (++cache->count[cls] > MT_CACHE_DEPTH) {
+        pthread_mutex_lock(&mt_lock);
+        mt_cache_drain(cache, cls, MT_CACHE_DEPTH / 2);
+        pthread_mutex_unlock(&mt_lock);
+      }
+      return SUCCESS;
+    }
+  }
+
+  pthread_mutex_lock(&mt_lock);
+  const l1_error err = l1_list_free(ptr);
+  pthread_mutex_unlock(&mt_lock);
+  return err;
+}
+/**********************************************************/
+
+/*********************** Statistics ***********************/
+#ifdef L1_ALLOC_STATS
+
+static l1_alloc_stats_t chunk_stats;
+static l1_alloc_stats_t list_stats;
+
+/** Helper function:
+ * Monotonic timestamp in nanoseconds
+ */
+static uint64_t stats_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** Helper function:
+ * Records an allocation of `size` bytes, served by `usable` bytes
+ */
+static void stats_alloc(l1_alloc_stats_t *stats, void *ptr, size_t size,
+                        size_t usable, uint64_t start)
+{
+  stats->alloc_ns += stats_now() - start;
+  stats->allocs++;
+  if (ptr == NULL) {
+    stats->failures += (size != 0);
+    return;
+  }
+  const unsigned cls = (size <= 1) ? 0 : CHUNK_WORD_BITS - __builtin_clzll(size - 1);
+  stats->class_allocs[cls < STATS_CLASSES ? cls : STATS_CLASSES - 1]++;
+  stats->in_use += usable;
+  if (stats->in_use > stats->peak)
+    stats->peak = stats->in_use;
+}
+
+/** Helper function:
+ * Records a free of `usable` bytes
+ */
+static void stats_free(l1_alloc_stats_t *stats, l1_error err, size_t usable,
+                       uint64_t start)
+{
+  stats->free_ns += stats_now() - start;
+  stats->frees++;
+  if (err == SUCCESS)
+    stats->in_use -= usable;
+}
+
+/** Helper function:
+ * Bytes requested by a calloc, saturated on overflow so that its failure
+ * still counts
+ */
+static size_t stats_calloc_size(size_t nmemb, size_t size)
+{
+  return (size != 0 && nmemb > SIZE_MAX / size) ? SIZE_MAX : nmemb * size;
+}
+
+/* Every entry point times the call and accounts for the usable bytes */
+#define STATS_ALLOC_ENTRY(stats, usable, call, size) \
+  do {                                               \
+    const uint64_t start = stats_now();              \
+    void *ptr = call;                                \
+    stats_alloc(stats, ptr, size, usable(ptr), start); \
+    return ptr;                                      \
+  } while (0)
+
+#define STATS_FREE_ENTRY(stats, usable, call, ptr) \
+  do {                                             \
+    const uint64_t start = stats_now();            \
+    const size_t bytes = usable(ptr);              \
+    const l1_error err = call;                     \
+    stats_free(stats, err, bytes, start);          \
+    return err;                                    \
+  } while (0)
+
+void *l1_chunk_malloc(size_t size)
+{
+  STATS_ALLOC_ENTRY(&chunk_stats, l1_chunk_usable_size,
+                    chunk_malloc(size), size);
+}
+
+l1_error l1_chunk_free(void *ptr)
+{
+  STATS_FREE_ENTRY(&chunk_stats, l1_chunk_usable_size, chunk_free(ptr), ptr);
+}
+
+void *l1_chunk_calloc(size_t nmemb, size_t size)
+{
+  STATS_ALLOC_ENTRY(&chunk_stats, l1_chunk_usable_size,
+                    chunk_calloc(nmemb, size),
+                    stats_calloc_size(nmemb, size));
+}
+
+void *l1_chunk_memalign(size_t alignment, size_t size)
+{
+  STATS_ALLOC_ENTRY(&chunk_stats, l1_chunk_usable_size,
+                    chunk_memalign(alignment, size), size);
+}
+
+void *l1_chunk_realloc(void *ptr, size_t size)
+{
+  const uint64_t start = stats_now();
+  const size_t old = l1_chunk_usable_size(ptr);
+  void *moved = chunk_realloc(ptr, size);
+  if (moved != NULL || size == 0)
+    chunk_stats.in_use += l1_chunk_usable_size(moved) - old;
+  else
+    chunk_stats.failures++;
+  if (chunk_stats.in_use > chunk_stats.peak)
+    chunk_stats.peak = chunk_stats.in_use;
+  chunk_stats.reallocs++;
+  chunk_stats.alloc_ns += stats_now() - start;
+  return moved;
+}
+
+void *l1_list_malloc(size_t size)
+{
+  STATS_ALLOC_ENTRY(&list_stats, l1_list_usable_size,
+                    list_malloc(size), size);
+}
+
+l1_error l1_list_free(void *ptr)
+{
+  STATS_FREE_ENTRY(&list_stats, l1_list_usable_size, list_free(ptr), ptr);
+}
+
+void *l1_list_calloc(size_t nmemb, size_t size)
+{
+  STATS_ALLOC_ENTRY(&list_stats, l1_list_usable_size,
+                    list_calloc(nmemb, size),
+                    stats_calloc_size(nmemb, size));
+}
+
+void *l1_list_memalign(size_t alignment, size_t size)
+{
+  STATS_ALLOC_ENTRY(&list_stats, l1_list_usable_size,
+                    list_memalign(alignment, size), size);
+}
+
+void *l1_list_realloc(void *ptr, size_t size)
+{
+  const uint64_t start = stats_now();
+  const size_t old = l1_list_usable_size(ptr);
+  void *moved = list_realloc(ptr, size);
+  if (moved != NULL || size == 0)
+    list_stats.in_use += l1_list_usable_size(moved) - old;
+  else
+    list_stats.failures++;
+  if (list_stats.in_use > list_stats.peak)
+    list_stats.peak = list_stats.in_use;
+  list_stats.reallocs++;
+  list_stats.alloc_ns += stats_now() - start;
+  return moved;
+}
+
+void l1_alloc_stats_reset(l1_allocator_t allocator)
+{
+  memset(allocator == L1_CHUNK ? &chunk_stats : &list_stats, 0,
+         sizeof(l1_alloc_stats_t));
+}
+
+l1_error l1_alloc_stats(l1_allocator_t allocator, l1_alloc_stats_t *stats)
+{
+  size_t free_bytes = 0;
+
+  if (allocator == L1_CHUNK) {
+    *stats = chunk_stats;
+    stats->free_regions = stats->largest_free = 0;
+    for (size_t i = 0, run = 0; i < l1_chunk_arena_length; i++) {
+      if (IS_CHUNK_TAKEN(i)) {
+        run = 0;
+        continue;
+      }
+      stats->free_regions += (run++ == 0);
+      free_bytes += CHUNK_SIZE;
+      if (run * CHUNK_SIZE > stats->largest_free)
+        stats->largest_free = run * CHUNK_SIZE;
+    }
+  } else if (allocator == L1_LIST) {
+    *stats = list_stats;
+    stats->free_regions = stats->largest_free = 0;
+    for (unsigned bin = 0; bin < LIST_BINS; bin++) {
+      for (l1_list_meta *cur = l1_list_bins[bin]; cur; cur = cur->next) {
+        stats->free_regions++;
+        free_bytes += cur->capacity;
+        if (cur->capacity > stats->largest_free)
+          stats->largest_free = cur->capacity;
+      }
+    }
+  } else {
+    return ERRINVAL;
+  }
+  stats->fragmentation = free_bytes
+      ? 1.0 - (double)stats->largest_free / free_bytes : 0.0;
   return SUCCESS;
 }
+
+#else
+/* Without statistics, the entry points are the implementations themselves */
+#define STATS_ALIAS(name, impl) \
+  __typeof__(impl) name __attribute__((alias(#impl)))
+
+STATS_ALIAS(l1_chunk_malloc, chunk_malloc);
+STATS_ALIAS(l1_chunk_free, chunk_free);
+STATS_ALIAS(l1_chunk_calloc, chunk_calloc);
+STATS_ALIAS(l1_chunk_memalign, chunk_memalign);
+STATS_ALIAS(l1_chunk_realloc, chunk_realloc);
+STATS_ALIAS(l1_list_malloc, list_malloc);
+STATS_ALIAS(l1_list_free, list_free);
+STATS_ALIAS(l1_list_calloc, list_calloc);
+STATS_ALIAS(l1_list_memalign, list_memalign);
+STATS_ALIAS(l1_list_realloc, list_realloc);
+#endif
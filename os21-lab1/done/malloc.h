@@ -6,68 +6,165 @@
  */
 #pragma once
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include "error.h"
 
 #define ALLOC8R_HEAP_SIZE (1024 * 1024)
 
+/* The chunk and list heaps reserve `ALLOC8R_RESERVE_SIZE` bytes of address
+ * space up front, but only map memory into it one segment at a time, when a
+ * request does not fit in the segments mapped so far. A segment with no live
+ * allocation left, other than the first one, has its pages returned to the OS
+ * with `madvise(MADV_DONTNEED)`, so that resident memory follows the live set.
+ *
+ * `l1_segment_size` is the size of a segment. It is read by `l1_chunk_init`
+ * and `l1_list_init`, and defaults to `ALLOC8R_HEAP_SIZE`.
+ */
+#define ALLOC8R_RESERVE_SIZE ((size_t)1 << 30) // 1GiB
+
+extern size_t l1_segment_size;
+
+/* Requests of more than `l1_mmap_threshold` bytes bypass the chunk and list
+ * heaps, and get an anonymous mapping of their own, which is unmapped as soon
+ * as they are freed. The mapping starts with a `l1_mmap_hdr`, and the data
+ * follows it. Live mappings are kept in a doubly linked list starting at
+ * `l1_mmap_head`, so that freeing a pointer from neither heap only looks at
+ * headers that are known to be mapped.
+ */
+#define ALLOC8R_MMAP_THRESHOLD (256 * 1024)
+
+typedef struct l1_mmap_hdr {
+  size_t length;             // Length of the whole mapping
+  struct l1_mmap_hdr *prev;
+  struct l1_mmap_hdr *next;
+} __attribute__((aligned(sizeof(max_align_t)))) l1_mmap_hdr;
+
+extern size_t l1_mmap_threshold;
+extern l1_mmap_hdr *l1_mmap_head;
+
 /* Week 5: Interface for heap memory allocator */
 extern void *(*l1_malloc)(size_t);
 extern l1_error (*l1_free)(void *);
 extern void (*l1_init)(void);
 extern void (*l1_deinit)(void);
+/* Resizing and zeroing allocation, with the semantics of realloc and calloc.
+ * They must be paired with the l1_malloc/l1_free of the same allocator. */
+extern void *(*l1_realloc)(void *, size_t);
+extern void *(*l1_calloc)(size_t, size_t);
+/* Allocation aligned to a power of two of at least `sizeof(void *)`, freed with
+ * l1_free. Other alignments fail with ERRINVAL. */
+extern void *(*l1_memalign)(size_t alignment, size_t size);
+
+/****** Statistics ******/
+#ifdef L1_ALLOC_STATS
+/* Built with -DL1_ALLOC_STATS (`make STATS=1`), every entry point of the chunk
+ * and list allocators is timed and accounted for. Without it, none of this
+ * exists and the entry points are the bare implementations. */
+#define STATS_CLASSES 32
+
+typedef enum {
+  L1_CHUNK,
+  L1_LIST,
+} l1_allocator_t;
+
+typedef struct {
+  size_t in_use;          // Usable bytes of the live allocations
+  size_t peak;            // Highest `in_use` since init
+  size_t free_regions;    // Runs of free chunks, or free list regions
+  size_t largest_free;    // Bytes of the largest of them
+  double fragmentation;   // 1 - largest_free / free bytes
+  uint64_t allocs;        // malloc, calloc and memalign calls
+  uint64_t frees;
+  uint64_t reallocs;
+  uint64_t failures;      // Calls of a non-zero size returning NULL
+  uint64_t alloc_ns;      // Time spent in allocations and reallocations
+  uint64_t free_ns;
+  /* Successful allocations of (2^(i-1), 2^i] bytes, the last one counting
+   * every larger size */
+  uint64_t class_allocs[STATS_CLASSES];
+} l1_alloc_stats_t;
+
+/**
+ * @brief      Snapshot of the statistics of an allocator
+ *
+ * Counters are reset by the allocator's init. The free space figures are
+ * computed from the chunk bitmap or the list bins at the time of the call;
+ * free slab objects and huge mappings are not part of them.
+ *
+ * @return     SUCCESS, or ERRINVAL for an unknown allocator.
+ */
+l1_error l1_alloc_stats(l1_allocator_t allocator, l1_alloc_stats_t *stats);
+
+/**
+ * @brief      Resets the counters of an allocator
+ */
+void l1_alloc_stats_reset(l1_allocator_t allocator);
+#endif
 
 /****** Standard libc based allocator *******************/
 void *libc_malloc(size_t size);
 l1_error libc_free(void *ptr);
+void *libc_realloc(void *ptr, size_t size);
+void *libc_calloc(size_t nmemb, size_t size);
+void *libc_memalign(size_t alignment, size_t size);
 
 /****** Chunk allocator: l1_chunk ******/
 /* The chunk allocator is a simple bin allocator with one type of bins. Starting
  * with a fixed-size heap region, it divides the region into fixed-size chunks.
  * The collection of all available chunks is henceforth called the "arena". The
- * arena has `CHUNK_ARENA_LENGTH` consecutive chunks, each `CHUNK_SIZE` bytes
- * long, starting at `l1_chunk_arena`. The chunk allocator also maintains, for
- * each chunk, a data structure of type `l1_chunk_desc_t` which describes the
- * status of that chunk. These data structures are stored in an array starting
- * at `l1_chunk_meta`. This array is mainly used to check whether a chunk is
- * allocated or free.
+ * arena has `l1_chunk_arena_length` consecutive chunks, each `CHUNK_SIZE` bytes
+ * long, starting at `l1_chunk_arena`, and grows by whole segments up to
+ * `CHUNK_RESERVE_LENGTH` chunks. With the default segment size, the first
+ * segment is `CHUNK_ARENA_LENGTH` chunks long. The chunk allocator also maintains one
+ * status bit per chunk, packed into words of type `l1_chunk_desc_t`. These
+ * words are stored in an array starting at `l1_chunk_meta`. This bitmap is
+ * used to check whether a chunk is allocated or free.
  * 
  * To allocate a region of some size S, a contiguous sequence of chunks is
- * reserved to fit the requested size, and an additional chunk directly
- * preceding that region must be allocated to store metadata describing that
- * region. For instance, with a chunk size of 4KiB, a requested region size of
- * 10KiB, and starting with an empty arena, one possible allocation output could
- * be:
- *   - Chunk 0: region metadata
+ * reserved to fit the requested size. For instance, with a chunk size of 4KiB,
+ * a requested region size of 10KiB, and starting with an empty arena, one
+ * possible allocation output could be:
+ *   - Chunk 0: data chunk
  *   - Chunk 1: data chunk
- *   - Chunk 2: data chunk
- *   - Chunk 3: data chunk (partially used, but entirely allocated)
+ *   - Chunk 2: data chunk (partially used, but entirely allocated)
  * 
- * The chunk storing region metadata accesses a data structure of type
- * `l1_region_hdr_t`, stored at the beginning of that chunk.
+ * The metadata describing a region is kept out of the arena, in a data
+ * structure of type `l1_region_hdr_t` stored in the side table `l1_region_meta`
+ * at the index of the first chunk of the region.
+ *
+ * Bit (x % 64) of word (x / 64) is set iff chunk x is taken, so searching for
+ * a run of free chunks works a word at a time rather than a chunk at a time.
  */
 
 #define CHUNK_SIZE (1 << 12) // 4KiB 
 #define CHUNK_ARENA_LENGTH (ALLOC8R_HEAP_SIZE / CHUNK_SIZE)
+#define CHUNK_RESERVE_LENGTH (ALLOC8R_RESERVE_SIZE / CHUNK_SIZE)
+
+#define CHUNK_WORD_BITS 64
+#define CHUNK_META_LENGTH \
+  ((CHUNK_RESERVE_LENGTH + CHUNK_WORD_BITS - 1) / CHUNK_WORD_BITS)
+#define CHUNK_WORD(x) ((x) / CHUNK_WORD_BITS)
+#define CHUNK_BIT(x) ((l1_chunk_desc_t)1 << ((x) % CHUNK_WORD_BITS))
 
-#define IS_CHUNK_FREE(x) (l1_chunk_meta[x] == 0)
-#define IS_CHUNK_TAKEN(x) (l1_chunk_meta[x] == 1)
-#define SET_CHUNK_FREE(x) (l1_chunk_meta[x] = 0)
-#define SET_CHUNK_TAKEN(x) (l1_chunk_meta[x] = 1)
+#define IS_CHUNK_FREE(x) ((l1_chunk_meta[CHUNK_WORD(x)] & CHUNK_BIT(x)) == 0)
+#define IS_CHUNK_TAKEN(x) (!IS_CHUNK_FREE(x))
+#define SET_CHUNK_FREE(x) (l1_chunk_meta[CHUNK_WORD(x)] &= ~CHUNK_BIT(x))
+#define SET_CHUNK_TAKEN(x) (l1_chunk_meta[CHUNK_WORD(x)] |= CHUNK_BIT(x))
 
 /**
- * The data structure used to store the metadata for each allocated chunk.
+ * The data structure used to store the chunk map: one word holds the status
+ * of `CHUNK_WORD_BITS` consecutive chunks.
  */
-typedef char l1_chunk_desc_t;
+typedef uint64_t l1_chunk_desc_t;
 
 /**
  * The data structure used to store the metadata for each allocated region. It
- * is stored in a header chunk directly preceding the region.
+ * is stored in `l1_region_meta` at the index of the region's first chunk.
  * 
- * Every allocated region of contiguous chunks is preceded by a chunk solely
- * dedicated to store metadata about that region. This metadata includes the
- * size of the region and a couple magic values surrounding the size field, used
- * as a sanity check when freeing the region.
+ * This metadata includes the size of the region and a couple magic values
+ * surrounding the size field, used as a sanity check when freeing the region.
+ * Entries of chunks which do not start an allocated region are zeroed.
  */
 typedef struct {
   max_align_t magic0;
@@ -75,6 +172,33 @@ typedef struct {
   max_align_t magic1;
 } l1_region_hdr_t;
 
+/* Requests of at most `SLAB_MAX_SIZE` bytes do not get a region of their own.
+ * They are rounded up to a power-of-two size class between `SLAB_MIN_SIZE`
+ * and `SLAB_MAX_SIZE` and served from a "slab": a single chunk carved into
+ * equally sized objects. Slab metadata lives in `l1_slab_meta`, indexed by
+ * chunk number, with one bit per object telling whether it is free. Slabs with
+ * free objects are kept on one list per size class, starting at
+ * `l1_slab_partial`.
+ */
+#define SLAB_MIN_SHIFT 4
+#define SLAB_MIN_SIZE (1 << SLAB_MIN_SHIFT) // 16B
+#define SLAB_MAX_SIZE (CHUNK_SIZE / 2) // 2KiB
+#define SLAB_CLASSES 8 // 16B, 32B, ... 2KiB
+#define SLAB_MAX_OBJECTS (CHUNK_SIZE / SLAB_MIN_SIZE)
+#define SLAB_MAP_LENGTH (SLAB_MAX_OBJECTS / 64)
+
+/**
+ * The data structure describing a chunk used as a slab. `size_class` is 0 for
+ * chunks that are not slabs, otherwise the size class index plus one.
+ */
+typedef struct l1_slab_desc {
+  struct l1_slab_desc *prev;          /** Previous partial slab of the class */
+  struct l1_slab_desc *next;          /** Next partial slab of the class */
+  unsigned size_class;                /** Size class index + 1, 0 if unused */
+  unsigned used;                      /** Objects currently allocated */
+  uint64_t free_map[SLAB_MAP_LENGTH]; /** Bit set iff the object is free */
+} l1_slab_desc_t;
+
 /**
  * A pointer to the start of the chunk arena. This is expected to be allocated
  * during initialization.
@@ -82,11 +206,33 @@ typedef struct {
 extern char (*l1_chunk_arena)[CHUNK_SIZE];
 
 /**
- * A pointer to an array of chunk metadata structures. This is expected to be
- * allocated during initialization.
+ * The number of chunks currently mapped in the arena.
+ */
+extern size_t l1_chunk_arena_length;
+
+/**
+ * A pointer to the chunk bitmap, `CHUNK_META_LENGTH` words long. This is
+ * expected to be allocated during initialization.
  */
 extern l1_chunk_desc_t *l1_chunk_meta;
 
+/**
+ * A pointer to an array of `CHUNK_RESERVE_LENGTH` region headers, one per chunk.
+ * This is expected to be allocated during initialization.
+ */
+extern l1_region_hdr_t *l1_region_meta;
+
+/**
+ * A pointer to an array of `CHUNK_RESERVE_LENGTH` slab descriptors, one per
+ * chunk. This is expected to be allocated during initialization.
+ */
+extern l1_slab_desc_t *l1_slab_meta;
+
+/**
+ * Heads of the per-size-class lists of slabs with at least one free object.
+ */
+extern l1_slab_desc_t *l1_slab_partial[SLAB_CLASSES];
+
 /**
  * A random magic value used for verifying that the region header is valid.
  */
@@ -95,9 +241,12 @@ extern max_align_t l1_region_magic;
 /**
  * @brief      Initializes the chunk arena and metadata
  * 
- * Allocates the entire chunk arena, consisting of `CHUNK_ARENA_LENGTH` chunks,
- * each `CHUNK_SIZE` bytes long. Additionally, it allocates the chunk metadata
- * storage region, `l1_chunk_meta`.
+ * Reserves address space for the whole chunk arena, and maps its first segment
+ * of `l1_segment_size` bytes (rounded up to whole chunks). Chunks are
+ * `CHUNK_SIZE` bytes long and aligned to `CHUNK_SIZE`. Additionally, it
+ * reserves the chunk metadata storage regions, `l1_chunk_meta`,
+ * `l1_region_meta` and `l1_slab_meta`, whose pages are only backed by memory
+ * once they are written.
  * 
  * If this function fails to allocate any of the required memory areas, it must
  *  exit with a status code of 1.
@@ -121,18 +270,22 @@ int magic_equals(max_align_t *magic0, max_align_t *magic1);
  * @brief      Allocates a region of chunks
  * 
  * Searches in the arena for a contiguous sequence of chunks to store the
- * requested size, in addition to a chunk directly preceding that region, which
- * serves as a region header.
+ * requested size, and records the region in `l1_region_meta`.
+ *
+ * Requests of at most `SLAB_MAX_SIZE` bytes are instead served from a slab of
+ * their size class, taking a new chunk as a slab only when every slab of that
+ * class is full. Such objects are aligned to their size class.
  * 
  * If the requested size is 0, the function must return a NULL pointer.
  * 
- * If the function fails to find a suitable region in the arena, it must set
- * `l1_errno` to ERRNOMEM and return a NULL pointer.
+ * If the function fails to find a suitable region in the arena, it maps enough
+ * new segments at the end of the arena to fit the request. If the reservation
+ * is exhausted, it must set `l1_errno` to ERRNOMEM and return a NULL pointer.
  *
  * @param[in]  size  The size, in bytes, of the region to be allocated.
  *
- * @return     A pointer to the first byte of the first allocated data chunk, or
- *             NULL if it fails.
+ * @return     A pointer to the first byte of the first allocated data chunk (or
+ *             of the slab object), or NULL if it fails.
  */
 void *l1_chunk_malloc(size_t size);
 
@@ -141,7 +294,12 @@ void *l1_chunk_malloc(size_t size);
  *
  * Returns all chunks in the provided region back to a "free" state. The
  * function must first verify that the provided pointer lies on valid chunk
- * boundaries, and that the region header chunk has valid magic values.
+ * boundaries, and that the region's entry in `l1_region_meta` has valid magic
+ * values. The entry is cleared, so that freeing the region twice fails.
+ *
+ * Pointers into a slab return their object to the slab instead. They must lie
+ * on an object boundary of an allocated object. A slab that becomes empty is
+ * given back to the arena, unless it is the last free slab of its class.
  * 
  * If the provided pointer is NULL, the function must return SUCCESS.
  * 
@@ -154,11 +312,175 @@ void *l1_chunk_malloc(size_t size);
  */
 l1_error l1_chunk_free(void *ptr);
 
+/**
+ * @brief      Resizes an allocation
+ *
+ * Regions shrink in place, giving their trailing chunks back to the arena, and
+ * grow in place when the chunks following them are free (growing the arena if
+ * the region ends it). Slab objects stay in place while the new size fits
+ * their size class. Huge allocations are resized with `mremap`. Otherwise, the
+ * data is copied to a new allocation and the old one is freed.
+ *
+ * A NULL `ptr` behaves as `l1_chunk_malloc(size)`, and a `size` of 0 frees
+ * `ptr` and returns NULL.
+ *
+ * If `ptr` is not a live allocation, the function must set `l1_errno` to
+ * ERRINVAL and return NULL. If memory runs out, it must set `l1_errno` to
+ * ERRNOMEM and return NULL, leaving `ptr` untouched.
+ *
+ * @param      ptr   The allocation to resize, or NULL.
+ * @param[in]  size  The new size, in bytes.
+ *
+ * @return     A pointer to the resized allocation, or NULL.
+ */
+void *l1_chunk_realloc(void *ptr, size_t size);
+
+/**
+ * @brief      Allocates a zeroed array of `nmemb` elements of `size` bytes
+ *
+ * If `nmemb * size` overflows, or memory runs out, the function must set
+ * `l1_errno` to ERRNOMEM and return NULL.
+ */
+void *l1_chunk_calloc(size_t nmemb, size_t size);
+
+/**
+ * @brief      Allocates `size` bytes aligned to `alignment`
+ *
+ * Alignments up to `SLAB_MAX_SIZE` are served from the slab of the size class
+ * fitting both, and alignments up to `CHUNK_SIZE` by a plain region. Larger
+ * alignments look for a run of free chunks starting on an aligned address, so
+ * that no chunk is wasted. Huge requests get an aligned mapping, trimmed of
+ * the pages mapped only to reach the alignment.
+ *
+ * If `alignment` is not a power of two of at least `sizeof(void *)`, the
+ * function must set `l1_errno` to ERRINVAL and return NULL. If memory runs
+ * out, it must set `l1_errno` to ERRNOMEM and return NULL.
+ *
+ * @return     A pointer to be released with `l1_chunk_free`, or NULL.
+ */
+void *l1_chunk_memalign(size_t alignment, size_t size);
+
+/**
+ * @brief      Returns the usable size of a live chunk allocation
+ *
+ * Slab objects are as large as their size class, regions span whole chunks
+ * and huge allocations reach the end of their mapping.
+ *
+ * @return     The usable size in bytes, or 0 for NULL.
+ */
+size_t l1_chunk_usable_size(void *ptr);
+
+/****** Buddy allocator: l1_buddy ******/
+/* The buddy allocator is an alternative allocation mode over the chunk arena.
+ * The arena is seen as a single block of order `BUDDY_MAX_ORDER`; a block of
+ * order k is `BUDDY_MIN_SIZE << k` bytes long, and is split into two "buddies"
+ * of order k - 1 when a smaller block is needed. Free blocks of each order are
+ * kept on a doubly linked list threaded through the blocks themselves, and a
+ * freed block is merged with its buddy as long as the buddy is free too.
+ *
+ * `l1_buddy_meta` has one byte per `BUDDY_MIN_SIZE` unit of the arena. The
+ * byte of the first unit of a block holds its order and whether it is free or
+ * allocated; all other bytes are 0. Blocks are aligned to their own size.
+ */
+#define BUDDY_MIN_SHIFT 6 // 64B
+#define BUDDY_MIN_SIZE (1 << BUDDY_MIN_SHIFT)
+#define BUDDY_MAX_ORDER 14 // BUDDY_MIN_SIZE << 14 == ALLOC8R_HEAP_SIZE
+#define BUDDY_UNITS (ALLOC8R_HEAP_SIZE / BUDDY_MIN_SIZE)
+
+#define BUDDY_ORDER_MASK 0x3f
+#define BUDDY_FREE 0x40
+#define BUDDY_TAKEN 0x80
+
+/**
+ * The data structure threading a free block into the list of its order.
+ */
+typedef struct l1_buddy_block {
+  struct l1_buddy_block *prev;
+  struct l1_buddy_block *next;
+} l1_buddy_block;
+
+/**
+ * Per-unit block descriptors, `BUDDY_UNITS` bytes long.
+ */
+extern uint8_t *l1_buddy_meta;
+
+/**
+ * Heads of the free lists, one per order.
+ */
+extern l1_buddy_block *l1_buddy_free_lists[BUDDY_MAX_ORDER + 1];
+
+/**
+ * Bit k is set iff the free list of order k is not empty.
+ */
+extern uint32_t l1_buddy_orders;
+
+/**
+ * @brief      Initializes the buddy allocator
+ *
+ * Allocates the chunk arena, aligned to its own size, as a single free block
+ * of order `BUDDY_MAX_ORDER`, along with `l1_buddy_meta`.
+ *
+ * If this function fails to allocate any of the required memory areas, it must
+ * exit with a status code of 1.
+ */
+void l1_buddy_init(void);
+
+/**
+ * @brief      Releases the arena and metadata of the buddy allocator.
+ */
+void l1_buddy_deinit(void);
+
+/**
+ * @brief      Allocates a block from the buddy allocator
+ *
+ * Takes the smallest free block of order at least the one fitting `size`,
+ * splitting it down to that order. This takes O(log n) time.
+ *
+ * If the requested size is 0, the function must return a NULL pointer.
+ *
+ * If no free block is large enough, it must set `l1_errno` to ERRNOMEM and
+ * return a NULL pointer.
+ *
+ * @param[in]  size  The size, in bytes, of the block to be allocated.
+ *
+ * @return     A pointer to the first byte of the block, or NULL if it fails.
+ */
+void *l1_buddy_malloc(size_t size);
+
+/**
+ * @brief      Releases a block to the buddy allocator
+ *
+ * Marks the block free and merges it with its buddy for as long as the buddy
+ * is free as well. This takes O(log n) time.
+ *
+ * If the provided pointer is NULL, the function must return SUCCESS.
+ *
+ * If the pointer is not the start of an allocated block, it must return
+ * ERRINVAL.
+ *
+ * @param      ptr   The pointer to the first byte of the block to be freed.
+ *
+ * @return     SUCCESS if no errors occured. Otherwise, ERRINVAL.
+ */
+l1_error l1_buddy_free(void *ptr);
+
 /****** Meta data for the free list allocator: l1_list *******/
 void *l1_list_malloc(size_t);
 l1_error l1_list_free(void *);
 void l1_list_init(void);
 void l1_list_deinit(void);
+/* Shrinks in place by splitting the region, and grows in place by absorbing
+ * the following region if it is free (growing the heap if it ends the heap);
+ * otherwise copies. Same contract as `l1_chunk_realloc`. */
+void *l1_list_realloc(void *, size_t);
+void *l1_list_calloc(size_t, size_t);
+/* Carves the aligned region out of a free region large enough for the data
+ * and a leading gap, which goes back to the bins as a free region of its own,
+ * as does the unused tail. Same contract as `l1_chunk_memalign`. */
+void *l1_list_memalign(size_t, size_t);
+/* Capacity of the region of a live allocation. Same contract as
+ * `l1_chunk_usable_size`. */
+size_t l1_list_usable_size(void *);
 
 typedef struct l1_list_meta {
   /* Every allocated region is preceded by a region containing the
@@ -169,15 +491,108 @@ typedef struct l1_list_meta {
    *    the beginning of `next` will also be similarly aligned. */
   max_align_t magic0;
   size_t capacity;
+  size_t free;    /* 1 iff the region is on the free list */
   max_align_t magic1 __attribute__((aligned(sizeof(max_align_t))));
   /* When a region of memory is allocated, it will span the 
    * address start from &next, and span `capacity` bytes. 
    * When a region of memory is free, the next few bytes will
-   * contain a pointer to the next region of free memory */
+   * contain pointers to the next and previous regions of free memory
+   * in the same bin */
   struct l1_list_meta *next;
+  struct l1_list_meta *prev;
 } l1_list_meta;
 
-extern l1_list_meta *l1_list_free_head;
+/**
+ * Boundary tag stored right after the `capacity` bytes of every region. It
+ * mirrors the header, so that a region being freed can find out in O(1)
+ * whether the region physically preceding it is free, and where it starts.
+ */
+typedef struct {
+  size_t capacity;
+  size_t free;
+} __attribute__((aligned(sizeof(max_align_t)))) l1_list_tag;
+
+/* Layout of a region: header up to `next`, data, boundary tag */
+#define LIST_HDR_SIZE offsetof(l1_list_meta, next)
+#define LIST_TAG_SIZE sizeof(l1_list_tag)
+/* A free region must be able to hold its `next` and `prev` pointers */
+#define LIST_MIN_CAPACITY (sizeof(l1_list_meta) - LIST_HDR_SIZE)
+/* Capacity of the single free region spanning an empty heap of the default
+ * segment size */
+#define LIST_MAX_CAPACITY (ALLOC8R_HEAP_SIZE - LIST_HDR_SIZE - LIST_TAG_SIZE)
+
+/* Free regions are kept in segregated bins. Regions of capacity up to
+ * `LIST_FAST_MAX` bytes have one exact-size bin per multiple of
+ * `sizeof(max_align_t)`; larger regions go to the bin of the largest power of
+ * two not above their capacity. Bit i of `l1_list_bin_map` is set iff bin i is
+ * not empty, so the smallest bin guaranteed to fit a request is found with a
+ * single find-first-set. Within the request's own power-of-two bin, at most
+ * `LIST_BIN_SCAN` regions are looked at for a best fit. */
+#define LIST_FAST_SHIFT 8
+#define LIST_FAST_MAX (1 << LIST_FAST_SHIFT) // 256B
+#define LIST_FAST_BINS (LIST_FAST_MAX / sizeof(max_align_t))
+#define LIST_BINS (LIST_FAST_BINS + 48 - LIST_FAST_SHIFT) // up to 2^48 B
+#define LIST_BIN_SCAN 16
+
+extern l1_list_meta *l1_list_bins[LIST_BINS];
+extern uint64_t l1_list_bin_map;
+/* The list heap starts at `l1_list_heap` and has `l1_list_heap_size` bytes
+ * mapped. When no free region fits a request, a new segment is mapped at its
+ * end and coalesced with the last region if that one is free. */
 extern void *l1_list_heap;
+extern size_t l1_list_heap_size;
 extern max_align_t l1_list_magic;
 
+/****** Thread-safe allocator: l1_mt ******/
+/* The thread-safe allocator puts a cache per thread in front of the list
+ * allocator, which becomes the central heap and is only used with a single
+ * mutex held. Requests of at most `MT_CACHE_MAX_SIZE` bytes are
+ * rounded up to a power-of-two size class; each thread keeps up to
+ * `MT_CACHE_DEPTH` freed blocks per class, linked through their first word.
+ * A thread missing in its cache takes `MT_CACHE_BATCH` blocks of the class
+ * from the central heap under a single lock, and a thread whose cache
+ * overflows gives half of the class back the same way. A block may be freed
+ * by any thread; it goes to the cache of the thread freeing it.
+ *
+ * Blocks in a cache still look allocated to the central heap. The caches of a
+ * thread are flushed when it exits, and dropped when the allocator is
+ * re-initialized, which bumps `l1_mt_generation`.
+ */
+#define MT_CACHE_MIN_SHIFT 5
+#define MT_CACHE_MAX_SIZE 2048
+#define MT_CACHE_CLASSES 7
+#define MT_CACHE_DEPTH 64
+#define MT_CACHE_BATCH 16
+
+extern unsigned l1_mt_generation;
+
+/**
+ * @brief      Initializes the central heap
+ *
+ * Must be called once, before any thread uses the allocator.
+ */
+void l1_mt_init(void);
+
+/**
+ * @brief      Releases the central heap
+ *
+ * Must be called once no thread uses the allocator anymore.
+ */
+void l1_mt_deinit(void);
+
+/**
+ * @brief      Allocates `size` bytes, from the calling thread's cache if it
+ *             holds a block of the size class
+ *
+ * Same contract as `l1_list_malloc`.
+ */
+void *l1_mt_malloc(size_t size);
+
+/**
+ * @brief      Frees a block, into the calling thread's cache if it belongs to
+ *             a size class
+ *
+ * Same contract as `l1_list_free`, except that freeing a cached block twice
+ * is not detected.
+ */
+l1_error l1_mt_free(void *ptr);
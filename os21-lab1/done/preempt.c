@@ -0,0 +1,96 @@
+/**
+ * @file preempt.c
+ * @brief Preemption timer and its signal handler
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "preempt.h"
+#include "schedule.h"
+/* Last: errno.h turns `errno` into a macro, which the thread info structs
+ * use as a field name */
+#include <errno.h>
+
+l1_time l1_preempt_tick = 0;
+uint64_t l1_preemptions = 0;
+volatile sig_atomic_t l1_preempt_depth = 0;
+
+/* A tick arrived while preemption was masked */
+static volatile sig_atomic_t preempt_pending = 0;
+
+static timer_t preempt_timer;
+static int preempt_armed = 0;
+static struct sigaction preempt_old_action;
+
+void l1_preempt_disable(void) {
+  l1_preempt_depth++;
+}
+
+void l1_preempt_enable(void) {
+  if (--l1_preempt_depth == 0 && preempt_pending) {
+    preempt_pending = 0;
+    if (schedule_preempt())
+      l1_preemptions++;
+  }
+}
+
+/** Helper function:
+ * SIGALRM handler. Runs on the stack of the interrupted thread and, if its
+ * slice is over, yields from there.
+ */
+static void preempt_handler(int sig) {
+  const int saved_errno = errno;
+  (void)sig;
+  if (l1_preempt_depth > 0) {
+    preempt_pending = 1;
+  } else if (schedule_preempt()) {
+    l1_preemptions++;
+  }
+  errno = saved_errno;
+}
+
+void l1_preempt_start(void) {
+  if (l1_preempt_tick == 0 || preempt_armed)
+    return;
+
+  /* The handler switches threads and may not return for a while: further
+   * ticks must not stay blocked until it does */
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = preempt_handler;
+  action.sa_flags = SA_RESTART | SA_NODEFER;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGALRM, &action, &preempt_old_action) != 0) {
+    perror("sigaction");
+    exit(-1);
+  }
+
+  struct sigevent event;
+  memset(&event, 0, sizeof(event));
+  event.sigev_notify = SIGEV_SIGNAL;
+  event.sigev_signo = SIGALRM;
+  if (timer_create(CLOCK_MONOTONIC, &event, &preempt_timer) != 0) {
+    perror("timer_create");
+    exit(-1);
+  }
+
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = l1_preempt_tick / L1_TIME_S;
+  spec.it_interval.tv_nsec = l1_preempt_tick % L1_TIME_S;
+  spec.it_value = spec.it_interval;
+  if (timer_settime(preempt_timer, 0, &spec, NULL) != 0) {
+    perror("timer_settime");
+    exit(-1);
+  }
+  preempt_armed = 1;
+}
+
+void l1_preempt_stop(void) {
+  if (!preempt_armed)
+    return;
+  timer_delete(preempt_timer);
+  sigaction(SIGALRM, &preempt_old_action, NULL);
+  preempt_pending = 0;
+  preempt_armed = 0;
+}
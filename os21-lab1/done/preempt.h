@@ -0,0 +1,54 @@
+/**
+ * @file preempt.h
+ * @brief Timer-driven preemption of the green threads
+ *
+ * When `l1_preempt_tick` is set, schedule() arms a SIGALRM interval timer
+ * for as long as threads run. On every tick, a thread that has run for its
+ * whole l1_priority_slice_size() is made to yield from the signal handler;
+ * the kernel saved its registers on its stack, and returning from the
+ * handler once it is scheduled again resumes it where it was interrupted.
+ *
+ * The handler may switch threads in the middle of any code, so code that
+ * must not be interleaved with other threads, including calls into libc
+ * that take locks (malloc, stdio), goes between l1_preempt_disable() and
+ * l1_preempt_enable(). The thread and scheduler functions mask preemption
+ * themselves.
+ */
+#pragma once
+#include <signal.h>
+#include "l1_time.h"
+
+/* Period of the preemption timer, 0 to leave threads cooperative */
+extern l1_time l1_preempt_tick;
+
+/* Number of threads preempted so far */
+extern uint64_t l1_preemptions;
+
+/* Depth of nested l1_preempt_disable() calls. The depth belongs to the
+ * running thread: the scheduler saves and restores it across switches */
+extern volatile sig_atomic_t l1_preempt_depth;
+
+/**
+ * @brief Masks preemption until the matching l1_preempt_enable()
+ *
+ * Calls nest. A tick that arrives while masked is remembered and handled by
+ * the outermost l1_preempt_enable().
+ */
+void l1_preempt_disable(void);
+
+/**
+ * @brief Unmasks preemption, preempting the thread now if a tick arrived
+ * while it was masked and its slice is over
+ */
+void l1_preempt_enable(void);
+
+/**
+ * @brief Installs the SIGALRM handler and arms the timer, if
+ * `l1_preempt_tick` is set. Called by schedule() before running threads.
+ */
+void l1_preempt_start(void);
+
+/**
+ * @brief Disarms the timer and restores the previous SIGALRM handler
+ */
+void l1_preempt_stop(void);
@@ -37,3 +37,17 @@ void l1_priority_increase(l1_priority* p) {
   }
   *p = *p + 1;
 }
+
+/* Weights of the levels, from LOWEST_PRIORITY to TOP_PRIORITY, following
+ * the nice levels +5 to -5 of Linux */
+static const uint32_t priority_weights[TOP_PRIORITY - LOWEST_PRIORITY + 1] = {
+  335, 423, 526, 655, 820, PRIORITY_WEIGHT_BASE, 1277, 1586, 1991, 2501, 3121,
+};
+
+uint32_t l1_priority_weight(l1_priority val) {
+  if (val < LOWEST_PRIORITY || val > TOP_PRIORITY) {
+    fprintf(stderr, "Error: invalid priority value in l1_priority_weight\n");
+    exit(-1);
+  }
+  return priority_weights[val - LOWEST_PRIORITY];
+}
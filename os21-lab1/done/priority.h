@@ -13,13 +13,13 @@ typedef int l1_priority;
 #define LOWEST_PRIORITY 0
 
 /* Maximum total time you can run at certain priority */
-#ifdef USE_UNIX_TIME
-#define TIME_PRIORITY_THRESHOLD ((uint64_t)200)
-#define MIN_SLICE 2
-#else
-#define TIME_PRIORITY_THRESHOLD ((uint64_t)1000000)
-#define MIN_SLICE 1000
-#endif
+#define TIME_PRIORITY_THRESHOLD (50 * L1_TIME_MS)
+/* Time slice of the top priority; each level below gets one more */
+#define MIN_SLICE (1 * L1_TIME_MS)
+
+/* CFS weight of a thread of middle priority. Each level above it gets
+ * about 1.25 times more CPU than the level below */
+#define PRIORITY_WEIGHT_BASE 1024
 
 /**
  * @brief Returns the value of a time slice at priority level val
@@ -36,3 +36,8 @@ void l1_priority_decrease(l1_priority* p);
  */
 void l1_priority_increase(l1_priority* p);
 
+
+/**
+ * @brief Returns the CFS weight of priority level val
+ */
+uint32_t l1_priority_weight(l1_priority val);
@@ -0,0 +1,230 @@
+/**
+ * @file rbtree.c
+ * @brief Implementation of the intrusive red-black tree.
+ */
+#include "rbtree.h"
+
+/** Helper function:
+ * Replaces `old` by `node` in the link from the parent of `old`
+ */
+static void rb_replace_child(l1_rb_tree *tree, l1_rb_node *old,
+                             l1_rb_node *node) {
+  if (old->parent == NULL)
+    tree->root = node;
+  else if (old->parent->left == old)
+    old->parent->left = node;
+  else
+    old->parent->right = node;
+  if (node != NULL)
+    node->parent = old->parent;
+}
+
+/** Helper function:
+ * Rotates left around `node`, whose right child takes its place
+ */
+static void rb_rotate_left(l1_rb_tree *tree, l1_rb_node *node) {
+  l1_rb_node *right = node->right;
+  node->right = right->left;
+  if (right->left != NULL)
+    right->left->parent = node;
+  rb_replace_child(tree, node, right);
+  right->left = node;
+  node->parent = right;
+}
+
+/** Helper function:
+ * Rotates right around `node`, whose left child takes its place
+ */
+static void rb_rotate_right(l1_rb_tree *tree, l1_rb_node *node) {
+  l1_rb_node *left = node->left;
+  node->left = left->right;
+  if (left->right != NULL)
+    left->right->parent = node;
+  rb_replace_child(tree, node, left);
+  left->right = node;
+  node->parent = left;
+}
+
+static bool rb_is_red(l1_rb_node *node) {
+  return node != NULL && node->red;
+}
+
+void rb_insert(l1_rb_tree *tree, l1_rb_node *node, l1_rb_less less) {
+  l1_rb_node *parent = NULL;
+  l1_rb_node **link = &tree->root;
+  bool leftmost = true;
+
+  while (*link != NULL) {
+    parent = *link;
+    if (less(node, parent)) {
+      link = &parent->left;
+    } else {
+      link = &parent->right;
+      leftmost = false;
+    }
+  }
+  node->parent = parent;
+  node->left = node->right = NULL;
+  node->red = true;
+  *link = node;
+  if (leftmost)
+    tree->leftmost = node;
+  tree->size++;
+
+  /* Restore the red-black properties up the tree */
+  while (rb_is_red(node->parent)) {
+    l1_rb_node *parent = node->parent;
+    l1_rb_node *grand = parent->parent;
+    if (parent == grand->left) {
+      l1_rb_node *uncle = grand->right;
+      if (rb_is_red(uncle)) {
+        parent->red = uncle->red = false;
+        grand->red = true;
+        node = grand;
+        continue;
+      }
+      if (node == parent->right) {
+        rb_rotate_left(tree, parent);
+        node = parent;
+        parent = node->parent;
+      }
+      parent->red = false;
+      grand->red = true;
+      rb_rotate_right(tree, grand);
+    } else {
+      l1_rb_node *uncle = grand->left;
+      if (rb_is_red(uncle)) {
+        parent->red = uncle->red = false;
+        grand->red = true;
+        node = grand;
+        continue;
+      }
+      if (node == parent->left) {
+        rb_rotate_right(tree, parent);
+        node = parent;
+        parent = node->parent;
+      }
+      parent->red = false;
+      grand->red = true;
+      rb_rotate_left(tree, grand);
+    }
+  }
+  tree->root->red = false;
+}
+
+/** Helper function:
+ * Restores the black height after removing a black node, where `node`
+ * (possibly NULL) is now the child of `parent` short of one black node
+ */
+static void rb_erase_fixup(l1_rb_tree *tree, l1_rb_node *node,
+                           l1_rb_node *parent) {
+  while (node != tree->root && !rb_is_red(node)) {
+    if (node == parent->left) {
+      l1_rb_node *sibling = parent->right;
+      if (rb_is_red(sibling)) {
+        sibling->red = false;
+        parent->red = true;
+        rb_rotate_left(tree, parent);
+        sibling = parent->right;
+      }
+      if (!rb_is_red(sibling->left) && !rb_is_red(sibling->right)) {
+        sibling->red = true;
+        node = parent;
+        parent = node->parent;
+        continue;
+      }
+      if (!rb_is_red(sibling->right)) {
+        sibling->left->red = false;
+        sibling->red = true;
+        rb_rotate_right(tree, sibling);
+        sibling = parent->right;
+      }
+      sibling->red = parent->red;
+      parent->red = false;
+      sibling->right->red = false;
+      rb_rotate_left(tree, parent);
+    } else {
+      l1_rb_node *sibling = parent->left;
+      if (rb_is_red(sibling)) {
+        sibling->red = false;
+        parent->red = true;
+        rb_rotate_right(tree, parent);
+        sibling = parent->left;
+      }
+      if (!rb_is_red(sibling->left) && !rb_is_red(sibling->right)) {
+        sibling->red = true;
+        node = parent;
+        parent = node->parent;
+        continue;
+      }
+      if (!rb_is_red(sibling->left)) {
+        sibling->right->red = false;
+        sibling->red = true;
+        rb_rotate_left(tree, sibling);
+        sibling = parent->left;
+      }
+      sibling->red = parent->red;
+      parent->red = false;
+      sibling->left->red = false;
+      rb_rotate_right(tree, parent);
+    }
+    node = tree->root;
+  }
+  if (node != NULL)
+    node->red = false;
+}
+
+void rb_erase(l1_rb_tree *tree, l1_rb_node *node) {
+  l1_rb_node *child;
+  l1_rb_node *parent;
+  bool removed_red;
+
+  /* The leftmost node has no left child: its successor is its right child
+   * if any, and its parent otherwise */
+  if (tree->leftmost == node) {
+    if (node->right != NULL) {
+      l1_rb_node *next = node->right;
+      while (next->left != NULL)
+        next = next->left;
+      tree->leftmost = next;
+    } else {
+      tree->leftmost = node->parent;
+    }
+  }
+
+  if (node->left == NULL || node->right == NULL) {
+    /* At most one child takes the place of the node */
+    child = (node->left != NULL) ? node->left : node->right;
+    parent = node->parent;
+    removed_red = node->red;
+    rb_replace_child(tree, node, child);
+  } else {
+    /* The successor, which has no left child, takes the place of the node */
+    l1_rb_node *next = node->right;
+    while (next->left != NULL)
+      next = next->left;
+    removed_red = next->red;
+    child = next->right;
+    if (next->parent == node) {
+      parent = next;
+    } else {
+      parent = next->parent;
+      rb_replace_child(tree, next, child);
+      next->right = node->right;
+      next->right->parent = next;
+    }
+    rb_replace_child(tree, node, next);
+    next->left = node->left;
+    next->left->parent = next;
+    next->red = node->red;
+  }
+
+  tree->size--;
+  node->parent = node->left = node->right = NULL;
+  if (!removed_red)
+    rb_erase_fixup(tree, child, parent);
+}
+
+l1_rb_node *rb_first(l1_rb_tree *tree) {
+  return tree->leftmost;
+}
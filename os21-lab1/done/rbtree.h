@@ -0,0 +1,54 @@
+/**
+ * @file rbtree.h
+ * @brief Header file for an intrusive red-black tree
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief A node of the tree, to embed in the structure it orders.
+ */
+typedef struct l1_rb_node {
+  struct l1_rb_node *parent;
+  struct l1_rb_node *left;
+  struct l1_rb_node *right;
+  bool red;
+} l1_rb_node;
+
+/* Order of the tree: returns true if `a` goes strictly before `b` */
+typedef bool (*l1_rb_less)(const l1_rb_node *a, const l1_rb_node *b);
+
+/**
+ * @brief A red-black tree, caching its leftmost node.
+ */
+typedef struct l1_rb_tree {
+  l1_rb_node *root;
+  l1_rb_node *leftmost;
+  size_t size;
+} l1_rb_tree;
+
+/* Gets the structure of type `type` embedding `node` as `member` */
+#define rb_entry(node, type, member) \
+  ((type *)((char *)(node) - offsetof(type, member)))
+
+/**
+ * @brief Inserts a node, after any node that compares equal to it.
+ *
+ * Runs in O(log n).
+ */
+void rb_insert(l1_rb_tree *tree, l1_rb_node *node, l1_rb_less less);
+
+/**
+ * @brief Removes a node from the tree.
+ * @warning The function does not check that node is in tree.
+ *
+ * Runs in O(log n).
+ */
+void rb_erase(l1_rb_tree *tree, l1_rb_node *node);
+
+/**
+ * @brief Returns the smallest node of the tree in O(1), or NULL if empty.
+ */
+l1_rb_node *rb_first(l1_rb_tree *tree);
@@ -38,34 +38,84 @@ l1_thread_info* l1_smallest_cycles_policy(l1_thread_info* prev, l1_thread_info*
   return smallest_cycles;
 }
 
+/** Helper function:
+ * Appends a thread to the queue of its priority level
+ */
+static void mlfq_push(l1_mlfq_queues *queues, l1_thread_info *thread) {
+  const int level = thread->priority_level - LOWEST_PRIORITY;
+  thread->rq_next = NULL;
+  thread->rq_prev = queues->tail[level];
+  if (queues->tail[level] != NULL)
+    queues->tail[level]->rq_next = thread;
+  else
+    queues->head[level] = thread;
+  queues->tail[level] = thread;
+  queues->nonempty |= 1u << level;
+  thread->boost_mark = queues->boosts;
+}
+
+/** Helper function:
+ * Unlinks a thread from the queue of level `level`
+ */
+static void mlfq_unlink(l1_mlfq_queues *queues, l1_thread_info *thread,
+                        int level) {
+  if (thread->rq_prev != NULL)
+    thread->rq_prev->rq_next = thread->rq_next;
+  else
+    queues->head[level] = thread->rq_next;
+  if (thread->rq_next != NULL)
+    thread->rq_next->rq_prev = thread->rq_prev;
+  else
+    queues->tail[level] = thread->rq_prev;
+  if (queues->head[level] == NULL)
+    queues->nonempty &= ~(1u << level);
+  thread->rq_prev = thread->rq_next = NULL;
+}
+
 /** Helper function: 
- * Increase priority of threads that did not run at their current priority 
+ * Increase priority of every queued thread by one level, by moving whole
+ * queues up. The top level absorbs the one below it.
  */
-void mlfq_boost(l1_thread_list *list) {
-  if (list == NULL)
-    return;
-  // Traverse through list and increase priority of each thread
-  for (l1_thread_info* cur = list->head; cur != NULL; cur = cur->next) {
-    if (!cur->got_scheduled) {
-      l1_time_init(&cur->total_time);
-      l1_priority_increase(&cur->priority_level);
+static void mlfq_boost(l1_mlfq_queues *queues) {
+  const int top = MLFQ_LEVELS - 1;
+  if (queues->head[top - 1] != NULL) {
+    if (queues->tail[top] != NULL) {
+      queues->tail[top]->rq_next = queues->head[top - 1];
+      queues->head[top - 1]->rq_prev = queues->tail[top];
+    } else {
+      queues->head[top] = queues->head[top - 1];
     }
+    queues->tail[top] = queues->tail[top - 1];
   }
+  for (int level = top - 1; level > 0; level--) {
+    queues->head[level] = queues->head[level - 1];
+    queues->tail[level] = queues->tail[level - 1];
+  }
+  queues->head[0] = queues->tail[0] = NULL;
+  queues->nonempty = (queues->nonempty & (1u << top))
+                     | ((queues->nonempty << 1) & ((1u << MLFQ_LEVELS) - 1));
+  queues->boosts++;
 }
 
 /** Helper function:
- * Find next thread to run in RR and ensure it is at back of list before running
+ * Takes the oldest thread of the highest non-empty level. A thread boosted
+ * while queued takes the level of its queue and starts its time over.
  */
-l1_thread_info *mlfq_next_thread(l1_thread_list *list) {
-  if (list == NULL)
+static l1_thread_info *mlfq_pop(l1_mlfq_queues *queues) {
+  if (queues->nonempty == 0)
     return NULL;
-  // Traverse through list to find thread with highest priority
-  l1_thread_info *max_prio_thread = list->head;
-  for (l1_thread_info *cur = list->head; cur != NULL; cur = cur->next) {
-    if (cur->priority_level > max_prio_thread->priority_level)
-      max_prio_thread = cur;
+  const int level = 31 - __builtin_clz(queues->nonempty);
+  l1_thread_info *thread = queues->head[level];
+  mlfq_unlink(queues, thread, level);
+  if (thread->boost_mark != queues->boosts) {
+    thread->priority_level = level + LOWEST_PRIORITY;
+    l1_time_init(&thread->total_time);
   }
-  return max_prio_thread;
+  return thread;
+}
+
+void l1_mlfq_enqueue(l1_thread_info *thread) {
+  mlfq_push(&get_scheduler()->mlfq, thread);
 }
 
 /** Schedules threads according to mlfq policy */
@@ -73,11 +123,7 @@ l1_thread_info* l1_mlfq_policy(l1_thread_info* prev, l1_thread_info* next) {
 
   /* TODO: Your code */
   l1_scheduler_info *sched = get_scheduler();
-  l1_thread_list *runnable = &sched->thread_arrays[RUNNABLE];
-  
-  /* Rule 5: Boost threads that did not run during SCHED_PERIOD slices */
-  if (sched->sched_ticks == 0)
-    mlfq_boost(runnable);
+  l1_mlfq_queues *queues = &sched->mlfq;
   
   /* Rule 4: Check whole time slice usage */
   l1_time cur_slice_time;
@@ -93,11 +139,88 @@ l1_thread_info* l1_mlfq_policy(l1_thread_info* prev, l1_thread_info* next) {
 
   /* Decrease thread priority if needed */
   if (used_whole_slice || above_threshold) {
+    /* A runnable prev was just queued at its old level */
+    const int queued = (prev->state == RUNNABLE);
+    if (queued)
+      mlfq_unlink(queues, prev, prev->priority_level - LOWEST_PRIORITY);
     l1_priority_decrease(&prev->priority_level);
     l1_time_init(&prev->total_time);
     prev->got_scheduled = 0;
+    if (queued)
+      mlfq_push(queues, prev);
   }
+
+  /* Rule 5: Boost threads waiting during SCHED_PERIOD slices */
+  if (sched->sched_ticks == 0)
+    mlfq_boost(queues);
   
-  return mlfq_next_thread(runnable); 
+  return mlfq_pop(queues); 
+}
+
+/** Helper function:
+ * Orders the CFS run queue by vruntime
+ */
+static bool cfs_less(const l1_rb_node *a, const l1_rb_node *b) {
+  return rb_entry(a, l1_thread_info, rq_node)->vruntime
+         < rb_entry(b, l1_thread_info, rq_node)->vruntime;
+}
+
+/** Helper function:
+ * Takes a queued thread out of the run queue to run it
+ */
+static l1_thread_info *cfs_take(l1_cfs_queue *queue, l1_thread_info *thread) {
+  rb_erase(&queue->tree, &thread->rq_node);
+  if (thread->vruntime > queue->min_vruntime)
+    queue->min_vruntime = thread->vruntime;
+  return thread;
+}
+
+/** Helper function:
+ * Charges the slice a thread just ran, once: `slice_end` is cleared after
+ */
+static void cfs_charge(l1_thread_info *thread) {
+  if (l1_time_are_equal(thread->slice_end, 0))
+    return;
+  l1_time slice;
+  l1_time_diff(&slice, thread->slice_end, thread->slice_start);
+  thread->vruntime += (uint64_t)slice * PRIORITY_WEIGHT_BASE
+                      / l1_priority_weight(thread->priority_level);
+  l1_time_init(&thread->slice_end);
 }
 
+void l1_cfs_enqueue(l1_thread_info *thread) {
+  l1_cfs_queue *queue = &get_scheduler()->cfs;
+  /* A yielding thread is queued with the slice it just ran */
+  cfs_charge(thread);
+  if (thread->vruntime < queue->min_vruntime)
+    thread->vruntime = queue->min_vruntime;
+  rb_insert(&queue->tree, &thread->rq_node, cfs_less);
+}
+
+/** Schedules the runnable thread that got the least weighted run time */
+l1_thread_info* l1_cfs_policy(l1_thread_info* prev, l1_thread_info* next) {
+  l1_scheduler_info *sched = get_scheduler();
+  l1_cfs_queue *queue = &sched->cfs;
+
+  /* Charge a prev that blocked or exited; a runnable one was charged when
+   * it was queued */
+  if (prev != sched->tsys)
+    cfs_charge(prev);
+
+  /* Honour yield targets */
+  if (next != NULL)
+    return cfs_take(queue, next);
+
+  l1_rb_node *first = rb_first(&queue->tree);
+  if (first == NULL)
+    return NULL;
+  return cfs_take(queue, rb_entry(first, l1_thread_info, rq_node));
+}
+
+sched_enqueue l1_policy_enqueue(sched_policy policy) {
+  if (policy == l1_mlfq_policy)
+    return l1_mlfq_enqueue;
+  if (policy == l1_cfs_policy)
+    return l1_cfs_enqueue;
+  return NULL;
+}
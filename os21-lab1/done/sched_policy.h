@@ -6,9 +6,23 @@
  */
 #pragma once
 #include "thread_info.h"
+#include "schedule.h"
 
 l1_thread_info* l1_round_robin_policy(l1_thread_info* prev, l1_thread_info* next);
 
 l1_thread_info* l1_smallest_cycles_policy(l1_thread_info* prev, l1_thread_info* next);
 
 l1_thread_info* l1_mlfq_policy(l1_thread_info* prev, l1_thread_info* next);
+
+/* Queues a runnable thread at its priority level for `l1_mlfq_policy` */
+void l1_mlfq_enqueue(l1_thread_info* thread);
+
+/* Fair-share policy: runs the runnable thread with the smallest vruntime,
+ * and charges each thread its run time scaled by its priority's weight */
+l1_thread_info* l1_cfs_policy(l1_thread_info* prev, l1_thread_info* next);
+
+/* Queues a runnable thread by vruntime for `l1_cfs_policy` */
+void l1_cfs_enqueue(l1_thread_info* thread);
+
+/* Returns the enqueue hook the policy needs, or NULL */
+sched_enqueue l1_policy_enqueue(sched_policy policy);
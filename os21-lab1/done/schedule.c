@@ -7,12 +7,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "schedule.h"
+#include "sched_policy.h"
 #include "stack.h"
 #include "thread.h"
 #include "l1_time.h"
+#include "preempt.h"
+#include "priority.h"
 
 l1_scheduler_info* scheduler = NULL; 
+int l1_yield_direct = 1;
 
 void initialize_scheduler(sched_policy policy) {
   scheduler = (l1_scheduler_info*) malloc(sizeof(l1_scheduler_info));
@@ -24,6 +29,7 @@ void initialize_scheduler(sched_policy policy) {
   /* Initialize scheduler */
   memset(scheduler, 0, sizeof(l1_scheduler_info)); 
   scheduler->next_tid = 0;
+  scheduler->io.epoll_fd = -1;
   
   /* Create tsys */
   scheduler->tsys = malloc(sizeof(l1_thread_info));
@@ -39,6 +45,7 @@ void initialize_scheduler(sched_policy policy) {
   scheduler->tsys->yield_target = -1;
   scheduler->tsys->thread_stack = malloc(sizeof(l1_stack));
   scheduler->select_next = policy;
+  scheduler->enqueue = l1_policy_enqueue(policy);
   scheduler->sched_ticks = 0;
 }
 
@@ -51,7 +58,10 @@ void clean_up_scheduler() {
     free(scheduler->tsys->thread_stack);
     scheduler->tsys->thread_stack = NULL;
   }
-  /* Free the scheduler */
+  /* Free the thread index, the recycled threads and the scheduler */
+  thread_table_clear(&scheduler->threads);
+  l1_io_clear(&scheduler->io);
+  l1_thread_pool_drain();
   free(scheduler);
   scheduler = NULL;
 }
@@ -64,6 +74,71 @@ l1_tid get_uniq_tid(){
   return scheduler->next_tid++;
 }
 
+/** Helper function:
+ * Hands a thread that just became runnable to the policy, if it wants it
+ */
+static void policy_enqueue(l1_thread_info* thread) {
+  if (scheduler->enqueue != NULL) {
+    scheduler->enqueue(thread);
+  }
+}
+
+void wake_thread(l1_thread_info* thread) {
+  thread_list_remove(&scheduler->thread_arrays[thread->state], thread);
+  thread->state = RUNNABLE;
+  thread_list_add(&scheduler->thread_arrays[RUNNABLE], thread);
+  policy_enqueue(thread);
+}
+
+/** Helper function:
+ * Makes the sleeping threads whose timers expired by `now`, and the threads
+ * whose descriptors are ready, runnable
+ */
+static void wake_waiters(l1_time now) {
+  l1_timer* timer = timer_wheel_expire(&scheduler->timers, now);
+  while (timer != NULL) {
+    l1_thread_info* thread = timer_entry(timer, l1_thread_info, sleep_timer);
+    timer = timer->next;
+    wake_thread(thread);
+  }
+  if (scheduler->io.waiting > 0) {
+    l1_io_poll(&scheduler->io, 0);
+  }
+}
+
+/** Helper function:
+ * Waits in tsys, when nothing is runnable, until the first sleeping thread
+ * is due or a descriptor is ready. Returns 0 if no thread waits.
+ */
+static int wait_for_waiters(void) {
+  l1_time when, now;
+  const int sleepers = timer_wheel_next(&scheduler->timers, &when);
+  const int io = (scheduler->io.waiting > 0);
+  if (!sleepers) {
+    if (io) {
+      l1_io_poll(&scheduler->io, -1);
+    }
+    return io;
+  }
+
+  l1_time_get(&now);
+  if (!l1_time_is_smaller(now, when)) {
+    return 1;
+  }
+  l1_time wait;
+  l1_time_diff(&wait, when, now);
+  /* epoll_wait counts in milliseconds: it covers the bulk of the wait, and
+   * the last fraction of a millisecond is slept */
+  if (io && wait >= L1_TIME_MS) {
+    l1_io_poll(&scheduler->io, wait / L1_TIME_MS);
+    return 1;
+  }
+  struct timespec ts = { wait / L1_TIME_S, wait % L1_TIME_S };
+  /* A preemption tick may cut the sleep short: the caller checks again */
+  clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+  return 1;
+}
+
 /* Put yourself on the tail of the associated scheduler queue*/
 void add_to_scheduler(l1_thread_info* thread, l1_thread_state state) {
   if (!thread) {
@@ -73,13 +148,98 @@ void add_to_scheduler(l1_thread_info* thread, l1_thread_state state) {
   thread->prev = thread->next = NULL;
   thread->state = state;
   thread_list_add(&scheduler->thread_arrays[state], thread);
+  if (state == RUNNABLE) {
+    policy_enqueue(thread);
+  }
+}
+
+/** Helper function:
+ * Finds the thread `tid` if it is in the list of `state`. The running
+ * thread belongs to the RUNNABLE list.
+ */
+static l1_thread_info* find_in_state(l1_tid tid, l1_thread_state state) {
+  l1_thread_info* thread = thread_table_find(&scheduler->threads, tid);
+  if (thread == NULL) {
+    return NULL;
+  }
+  if (thread->state == state || (state == RUNNABLE && thread->state == RUNNING)) {
+    return thread;
+  }
+  return NULL;
+}
+
+/** Helper function:
+ * Accounts for the slice `current` just ran, deschedules it if it blocked
+ * or died, and asks the policy for the next thread. Returns NULL if there is
+ * nothing left to run.
+ */
+static l1_thread_info* schedule_pick(l1_thread_info* current) {
+  l1_thread_info* next = NULL;
+  l1_tid target = current->yield_target;
+
+  /*Timestamp the end of slice*/
+  l1_time_get(&current->slice_end);
+  l1_time diff;
+  l1_time_diff(&diff, current->slice_end, current->slice_start);
+  l1_time_add(&current->total_time, diff);
+
+  /* Enforce non-global state */
+  scheduler->current = NULL;
+  current->errno = SUCCESS;
+
+  if (current->state == RUNNING) {
+    current->state = RUNNABLE;
+    if (target != -1) {
+      next = find_in_state(target, RUNNABLE);
+      if (next == NULL) {
+        current->errno = ERRINVAL;
+      }
+    }
+    /* fake rotate the list. */
+    thread_list_remove(&scheduler->thread_arrays[RUNNABLE], current);
+    thread_list_add(&scheduler->thread_arrays[RUNNABLE], current);
+    policy_enqueue(current);
+  }
+
+  /* The thread is blocking */
+  if (current != scheduler->tsys &&
+      (current->state == BLOCKED || current->state == ZOMBIE
+       || current->state == SLEEPING || current->state == IO_WAIT)) {
+    handle_non_runnable(current);
+  }
+  wake_waiters(current->slice_end);
+  /* Give a chance to the scheduling algorithm to bypass yield*/
+  return scheduler->select_next(current, next);
+}
+
+/** Helper function:
+ * Makes `next` the running thread, starting its slice
+ */
+static void schedule_run(l1_thread_info* next) {
+  scheduler->current = next;
+  next->state = RUNNING;
+  next->got_scheduled = scheduler->sched_ticks;
+  /*Make the thread the head of the list*/
+  thread_list_remove(&scheduler->thread_arrays[RUNNABLE], next);
+  thread_list_prepend(&scheduler->thread_arrays[RUNNABLE], next);
+  l1_time_init(&next->slice_end);
+  l1_time_get(&next->slice_start);
+
+  /* Scheduler ticks */
+  scheduler->sched_ticks = (scheduler->sched_ticks+1) % SCHED_PERIOD;
 }
 
 /**
  * @brief always executes on tsys
  */
 void schedule() {
-  while(!thread_list_is_empty(&scheduler->thread_arrays[RUNNABLE])) {
+  /* tsys itself is never preempted */
+  l1_preempt_disable();
+  l1_preempt_start();
+  const sig_atomic_t depth = l1_preempt_depth;
+  while(!thread_list_is_empty(&scheduler->thread_arrays[RUNNABLE])
+        || !thread_list_is_empty(&scheduler->thread_arrays[SLEEPING])
+        || !thread_list_is_empty(&scheduler->thread_arrays[IO_WAIT])) {
     if (scheduler == NULL || scheduler->current  == NULL) {
       fprintf(stderr, "Error: null pointer in scheduler logic.\n");
       exit(-1);
@@ -93,64 +253,33 @@ void schedule() {
     }
 
     l1_thread_info* current = scheduler->current;
-    l1_thread_info* next = NULL;
-    l1_tid target = scheduler->current->yield_target;
-
-    /*Timestamp the end of slice*/
-    l1_time_get(&current->slice_end);
-    l1_time diff;
-    l1_time_diff(&diff, current->slice_end, current->slice_start);
-    l1_time_add(&current->total_time, diff);
-
-    /* Enforce non-global state */
-    scheduler->current = NULL;
-    current->errno = SUCCESS;
-    
-    if (current->state == RUNNING) {
-      current->state = RUNNABLE;
-      if (target != -1) {
-        next = thread_list_find(&scheduler->thread_arrays[RUNNABLE], target);
-        if (next == NULL) {
-          current->errno = ERRINVAL;
-        }
-      }
-      /* fake rotate the list. */
-      thread_list_remove(&scheduler->thread_arrays[RUNNABLE], current);
-      thread_list_add(&scheduler->thread_arrays[RUNNABLE], current);
-    }
-
-    /* The thread is blocking */
-    if (current != scheduler->tsys && 
-        (current->state == BLOCKED || current->state == ZOMBIE)) {
-      handle_non_runnable(current);
-    }
-    /* Give a chance to the scheduling algorithm to bypass yield*/
-    next = scheduler->select_next(current, next);
+    l1_thread_info* next = schedule_pick(current);
 
     /* Now it is safe to free the thread if it is dead */
     if (current->state == DEAD) {
-      l1_stack_free(current->thread_stack);
-      free(current);
+      l1_thread_free(current);
       current = NULL;
+    } else if (current->state == ZOMBIE) {
+      /* A zombie only waits for its joiner: its stack can go already */
+      l1_stack_free(current->thread_stack);
+      current->thread_stack = NULL;
     }
    
-    /* Nothing to schedule anymore.*/
+    /* Nothing to schedule anymore, unless threads sleep or wait for I/O:
+     * wait for them and pick again on behalf of tsys */
     if (next == NULL) {
-      break;
+      if (!wait_for_waiters()) {
+        break;
+      }
+      scheduler->current = scheduler->tsys;
+      continue;
     }
-    scheduler->current = next;
-    next->state = RUNNING;
-    next->got_scheduled = scheduler->sched_ticks;
-    /*Make the thread the head of the list*/
-    thread_list_remove(&scheduler->thread_arrays[RUNNABLE], next);
-    thread_list_prepend(&scheduler->thread_arrays[RUNNABLE], next);
-    l1_time_init(&next->slice_end);
-    l1_time_get(&next->slice_start);
-    
-    /* Scheduler ticks */
-    scheduler->sched_ticks = (scheduler->sched_ticks+1) % SCHED_PERIOD;
+    schedule_run(next);
     switch_asm((uint64_t*)next->thread_stack->top, (uint64_t**)&scheduler->tsys->thread_stack->top);
+    l1_preempt_depth = depth;
   }
+  l1_preempt_stop();
+  l1_preempt_enable();
   printf("Program terminating!\n"); 
 }
 
@@ -159,7 +288,8 @@ void handle_non_runnable(l1_thread_info* current) {
     fprintf(stderr, "Error: current is null in handle_non_runnable.\n");
     exit(-1);
   }
-  if (current->state != BLOCKED && current->state != ZOMBIE) {
+  if (current->state != BLOCKED && current->state != ZOMBIE
+      && current->state != SLEEPING && current->state != IO_WAIT) {
     fprintf(stderr, "Error: handle_non_runnable called  with invalid state.\n");
     exit(-1);
   }
@@ -168,6 +298,12 @@ void handle_non_runnable(l1_thread_info* current) {
   thread_list_remove(&scheduler->thread_arrays[RUNNABLE], current);
   thread_list_add(&scheduler->thread_arrays[current->state], current);
 
+  /* Thread sleeps or waits for I/O: its timer or its descriptor is
+   * already registered */
+  if (current->state == SLEEPING || current->state == IO_WAIT) {
+    return;
+  }
+
   /* Thread called join */
   if (current->state == BLOCKED) {
     l1_tid target = current->joined_target;
@@ -177,42 +313,54 @@ void handle_non_runnable(l1_thread_info* current) {
       return;
     }
 
-    /* Look for the target in zombie, runnable, and blocked lists */
-    l1_thread_info* joined = thread_list_find(&scheduler->thread_arrays[ZOMBIE], target);
+    /* Look for the target in zombie, runnable, blocked and waiting lists */
+    l1_thread_info* joined = find_in_state(target, ZOMBIE);
     if (joined != NULL) {
       unblock_thread(current, joined);
+      /* The zombie is off every list and not running: release it now */
+      l1_thread_free(joined);
       return;
     }
-    joined = thread_list_find(&scheduler->thread_arrays[BLOCKED], target);
-    if (joined != NULL) { 
-      return;
+    joined = find_in_state(target, BLOCKED);
+    if (joined == NULL) {
+      joined = find_in_state(target, SLEEPING);
+    }
+    if (joined == NULL) {
+      joined = find_in_state(target, IO_WAIT);
+    }
+    if (joined == NULL) {
+      joined = find_in_state(target, RUNNABLE);
     }
-    
-    joined = thread_list_find(&scheduler->thread_arrays[RUNNABLE], target);
     if (joined != NULL) { 
+      /* Wait in the target's queue until it exits */
+      current->join_next = NULL;
+      if (joined->joiners_tail != NULL) {
+        joined->joiners_tail->join_next = current;
+      } else {
+        joined->joiners_head = current;
+      }
+      joined->joiners_tail = current;
       return;
     }
     unblock_thread(current, NULL);
     return;
   }
 
-  /* We are a zombie and need to unblock people. */
-  l1_thread_info* bl = scheduler->thread_arrays[BLOCKED].head;
-  l1_thread_info* joined = NULL;
-  while(bl != NULL) {
-    if (bl->joined_target == current->id) {
-      l1_thread_info* to_rm = bl;
-      if (joined == NULL) {
-        joined = to_rm;
-      } else {
-        unblock_thread(to_rm, NULL);
-      }
-    }
-    bl = bl->next;
+  /* We are a zombie and need to unblock people. The first joiner gets the
+   * return value, the others fail with ERRINVAL. */
+  l1_thread_info* joined = current->joiners_head;
+  current->joiners_head = current->joiners_tail = NULL;
+  if (joined == NULL) {
+    return;
   }
-  if (joined != NULL) {
-   unblock_thread(joined, current);
+  for (l1_thread_info* bl = joined->join_next; bl != NULL; ) {
+    l1_thread_info* to_rm = bl;
+    bl = bl->join_next;
+    to_rm->join_next = NULL;
+    unblock_thread(to_rm, NULL);
   }
+  joined->join_next = NULL;
+  unblock_thread(joined, current);
 }
 
 void unblock_thread(l1_thread_info* blocked, l1_thread_info* zombie) {
@@ -234,6 +382,7 @@ void unblock_thread(l1_thread_info* blocked, l1_thread_info* zombie) {
     blocked->joined_target = -1;
     thread_list_remove(&scheduler->thread_arrays[BLOCKED], blocked);
     thread_list_add(&scheduler->thread_arrays[RUNNABLE], blocked);
+    policy_enqueue(blocked);
     return;
   }
 
@@ -245,21 +394,63 @@ void unblock_thread(l1_thread_info* blocked, l1_thread_info* zombie) {
   blocked->joined_target = -1;
   thread_list_remove(&scheduler->thread_arrays[BLOCKED], blocked);
   thread_list_add(&scheduler->thread_arrays[RUNNABLE], blocked);
+  policy_enqueue(blocked);
   thread_list_remove(&scheduler->thread_arrays[ZOMBIE], zombie);
   /* Mark as dead to free it in schedule */
   zombie->state = DEAD;
 }
 
 void yield(l1_tid tid) {
+  l1_thread_info* current = scheduler->current;
+  /* The scheduler's state must not change under it. The mask depth is the
+   * thread's own: whoever switches back to it leaves theirs behind */
+  l1_preempt_disable();
+  const sig_atomic_t depth = l1_preempt_depth;
   /* Setup the target */
-  scheduler->current->yield_target = tid;
+  current->yield_target = tid;
 
-  /* Always go back to tsys */
-  switch_asm((uint64_t*)scheduler->tsys->thread_stack->top,
-              (uint64_t**)&scheduler->current->thread_stack->top);
+  /* A thread that stays runnable picks its successor itself and switches
+   * straight to it. Blocking and dying go through tsys, which frees the
+   * dead and stops once nothing is runnable */
+  if (l1_yield_direct && current != scheduler->tsys
+      && current->state == RUNNING) {
+    l1_thread_info* next = schedule_pick(current);
+    if (next == NULL) {
+      next = current;
+    }
+    schedule_run(next);
+    if (next != current) {
+      switch_asm((uint64_t*)next->thread_stack->top,
+                 (uint64_t**)&current->thread_stack->top);
+    }
+  } else {
+    switch_asm((uint64_t*)scheduler->tsys->thread_stack->top,
+                (uint64_t**)&current->thread_stack->top);
+  }
   /* Nothing to do, we are rescheduled.  */
+  l1_preempt_depth = depth;
+  l1_preempt_enable();
 }
 
+int schedule_preempt(void) {
+  l1_thread_info* current = (scheduler != NULL) ? scheduler->current : NULL;
+  if (current == NULL || current == scheduler->tsys
+      || current->state != RUNNING) {
+    return 0;
+  }
+  l1_time now, ran;
+  l1_time_get(&now);
+  l1_time_diff(&ran, now, current->slice_start);
+  if (l1_time_is_smaller(ran, l1_priority_slice_size(current->priority_level))) {
+    return 0;
+  }
+  /* The thread was interrupted, not calling into the scheduler: it keeps
+   * the error it had */
+  const l1_error saved = current->errno;
+  yield(-1);
+  current->errno = saved;
+  return 1;
+}
 
 void switch_asm(uint64_t* dest, uint64_t** orig) {
   asm volatile(
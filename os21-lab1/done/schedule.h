@@ -7,6 +7,8 @@
 #pragma once
 #include "thread_info.h"
 #include "thread_list.h"
+#include "thread_table.h"
+#include "l1_io.h"
 
 /* Week 4: Interface for scheduling */
 typedef l1_thread_info* (*sched_policy) (l1_thread_info*, l1_thread_info*);
@@ -14,13 +16,50 @@ typedef l1_thread_info* (*sched_policy) (l1_thread_info*, l1_thread_info*);
 /* Answers the question "what does periodically mean?" in terms of sched_ticks*/
 #define SCHED_PERIOD 10
 
+/* Policy hook, called whenever a thread becomes runnable: when it is
+ * created, when it wakes up and when it yields. NULL if the policy only
+ * works off the RUNNABLE list. The policy takes threads out of its own run
+ * queues when it picks them. */
+typedef void (*sched_enqueue) (l1_thread_info*);
+
+/* Run queues of the MLFQ policy: one FIFO per priority level, linked
+ * through `rq_prev`/`rq_next`, and a bitmap of the non-empty levels. A
+ * boost moves whole queues up one level; threads learn their new level when
+ * they leave the queue, by comparing their `boost_mark` to `boosts`. */
+#define MLFQ_LEVELS (TOP_PRIORITY - LOWEST_PRIORITY + 1)
+typedef struct {
+  l1_thread_info* head[MLFQ_LEVELS];  /** Oldest thread of each level */
+  l1_thread_info* tail[MLFQ_LEVELS];  /** Newest thread of each level */
+  uint32_t nonempty;                  /** Bit i set if level i has threads */
+  uint64_t boosts;                    /** Number of boosts so far */
+} l1_mlfq_queues;
+
+/* Run queue of the CFS policy: threads ordered by `vruntime`, the run time
+ * they were charged scaled down by their weight. Threads that join the
+ * queue start no lower than `min_vruntime`, so that sleeping does not buy
+ * them a burst of CPU. */
+typedef struct {
+  l1_rb_tree tree;                    /** Runnable threads by vruntime */
+  uint64_t min_vruntime;              /** Lowest vruntime picked so far */
+} l1_cfs_queue;
+
+/* When set, a yielding thread that stays runnable switches straight to the
+ * next thread instead of going through tsys. Cleared only to benchmark */
+extern int l1_yield_direct;
+
 typedef struct {
   l1_thread_info* current;                          /** Current thread */
   l1_tid next_tid;                                  /** Next thread */
   l1_thread_info* tsys;                             /** System thread */
   sched_policy select_next;                         /** Scheduler policy */
   l1_thread_list thread_arrays[NUM_THREAD_STATES];  /** Lists for the threads in different states. */
+  l1_thread_table threads;                          /** Index of the live threads by ID */
   uint64_t sched_ticks;                             /** Scheduler ticks */
+  sched_enqueue enqueue;                            /** Policy hook for runnable threads */
+  l1_mlfq_queues mlfq;                              /** Run queues of the MLFQ policy */
+  l1_cfs_queue cfs;                                 /** Run queue of the CFS policy */
+  l1_timer_wheel timers;                            /** Timers of the sleeping threads */
+  l1_io_reactor io;                                 /** Threads waiting for I/O */
 } l1_scheduler_info;
 
 /**
@@ -58,19 +97,30 @@ void add_to_scheduler(l1_thread_info* thread, l1_thread_state state);
  * 1. Check the currently scheduled thread. If it has a yield target,
  * find the corresponding thread.
  * 2. If the current thread state is non-runnable, deschedule it.
- * 3. If the yield target is undefined, call the scheduler's select_next method.
- * 4. Change the state of the current thread.
- * 5. Schedule the next thread.
- * 6. Switch from tsys to the next thread.
+ * 3. Wake up the sleeping threads whose timers expired, and the threads
+ * whose descriptors are ready.
+ * 4. If the yield target is undefined, call the scheduler's select_next method.
+ * 5. Change the state of the current thread.
+ * 6. Schedule the next thread.
+ * 7. Switch from tsys to the next thread.
+ *
+ * When nothing is runnable but threads sleep or wait for I/O, tsys waits in
+ * epoll_wait or clock_nanosleep until one of them can run.
  *
  */
 void schedule();
 
 /**
- * @brief handles cleanup for dead threads and joins
+ * @brief handles cleanup for dead threads and joins, and puts sleeping and
+ * I/O waiting threads aside
  */
 void handle_non_runnable(l1_thread_info* current);
 
+/**
+ * @brief Makes a SLEEPING or IO_WAIT thread runnable again
+ */
+void wake_thread(l1_thread_info* thread);
+
 /**
  * @brief unblocks blocked thread and collects zombie if not null.
  *
@@ -100,10 +150,25 @@ void unblock_thread(l1_thread_info* blocked, l1_thread_info* zombie);
  * The function will resume from this point at some later point in time as
  * decide by the scheduler (may be immediately).
  * 
- * yield(-1) yields to the system thread
+ * yield(-1) lets the policy pick the next thread
+ *
+ * If the thread stays runnable, it runs the policy itself and switches
+ * directly to the chosen thread. Only a thread that blocks or dies switches
+ * to tsys, which picks the next thread in `schedule`.
  */
 void yield(l1_tid next);
 
+/**
+ * @brief Preempts the running thread if it has used up its slice
+ *
+ * Called from the preemption timer's signal handler, see preempt.h, on the
+ * stack of the interrupted thread. The thread yields, and the call returns
+ * once it is scheduled again.
+ *
+ * @return 1 if the thread was preempted, 0 if it keeps running
+ */
+int schedule_preempt(void);
+
 /**
  * @brief switch_asm saves the current stack state in orig, and switches
  * to dest stack.
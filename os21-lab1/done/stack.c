@@ -6,27 +6,68 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "stack.h"
 
+unsigned l1_stack_pool_limit = STACK_POOL_MAX;
+
+/* Stacks freed and kept for reuse */
+static l1_stack* stack_pool[STACK_POOL_MAX];
+static unsigned stack_pool_count = 0;
+
 l1_stack* l1_stack_new(void) {
-  l1_stack* l1_stack_new = (l1_stack*)malloc(sizeof(l1_stack));
-  if( l1_stack_new == NULL ) 
+  /* Reuse a pooled stack; its contents are stale but never read */
+  if (stack_pool_count > 0) {
+    l1_stack* pooled = stack_pool[--stack_pool_count];
+    pooled->size = 0;
+    pooled->top = pooled->base + pooled->capacity;
+    return pooled;
+  }
+
+  const size_t page = sysconf(_SC_PAGESIZE);
+  char* mapping = mmap(NULL, STACK_RESERVE_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,
+                       -1, 0);
+  if (mapping == MAP_FAILED)
     return NULL;
-  l1_stack_new->capacity = MAX_STACK_CAPACITY;
-  l1_stack_new->size = 0;
-  l1_stack_new->base = (uint64_t*)malloc(l1_stack_new->capacity * sizeof(uint64_t));
-  if( l1_stack_new->base == NULL ) {
-    free(l1_stack_new);
+  if (mprotect(mapping, page, PROT_NONE) != 0) {
+    munmap(mapping, STACK_RESERVE_SIZE);
     return NULL;
   }
+
+  /* The stack structure takes the top words, keeping the top 16-byte
+   * aligned for the System-V ABI */
+  const size_t hdr = (sizeof(l1_stack) + 15) & ~(size_t)15;
+  l1_stack* l1_stack_new = (l1_stack*)(mapping + STACK_RESERVE_SIZE - hdr);
+  l1_stack_new->base = (uint64_t*)(mapping + page);
+  l1_stack_new->capacity = (STACK_RESERVE_SIZE - page - hdr) / sizeof(uint64_t);
+  l1_stack_new->size = 0;
   /* Point top to last element in the stack */
   l1_stack_new->top = l1_stack_new->base + (l1_stack_new->capacity);
   return l1_stack_new;
 }
 
+/** Helper function:
+ * Unmaps a stack, guard page included
+ */
+static void stack_unmap(l1_stack* thread_stack) {
+  munmap((char*)thread_stack->base - sysconf(_SC_PAGESIZE), STACK_RESERVE_SIZE);
+}
+
 void l1_stack_free(l1_stack* thread_stack) {
-  free(thread_stack->base);
-  free(thread_stack);
+  if (stack_pool_count < l1_stack_pool_limit
+      && stack_pool_count < STACK_POOL_MAX) {
+    stack_pool[stack_pool_count++] = thread_stack;
+    return;
+  }
+  stack_unmap(thread_stack);
+}
+
+void l1_stack_pool_drain(void) {
+  while (stack_pool_count > 0) {
+    stack_unmap(stack_pool[--stack_pool_count]);
+  }
 }
 
 bool l1_stack_is_full(l1_stack* thread_stack) {
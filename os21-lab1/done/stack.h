@@ -8,9 +8,19 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-/* Each thread allocates a stack of capacity = MAX_STACK_CAPACITY words
- * On a 64-bit architecture, a word is 64 bits */
-#define MAX_STACK_CAPACITY  1024
+/* Each thread maps STACK_RESERVE_SIZE bytes for its stack. The lowest page
+ * is a PROT_NONE guard, so that an overflow faults instead of corrupting
+ * memory, and the `l1_stack` itself sits at the top. The rest holds up to
+ * MAX_STACK_CAPACITY words; on a 64-bit architecture, a word is 64 bits.
+ * The mapping is only reserved: pages are committed as the thread touches
+ * them, so an idle thread costs about one page */
+#define STACK_RESERVE_SIZE  (256 * 1024)
+#define MAX_STACK_CAPACITY  (STACK_RESERVE_SIZE / sizeof(uint64_t))
+
+/* Freed stacks are kept for reuse, up to `l1_stack_pool_limit` of them.
+ * The limit can be lowered at runtime, down to 0 to disable the pool */
+#define STACK_POOL_MAX  256
+extern unsigned l1_stack_pool_limit;
 
 /**
  * @brief A stack structure
@@ -19,14 +29,15 @@ typedef struct {
   unsigned capacity;  /** Capacity of the stack (in 64-bit chunks) */
   unsigned size;      /** Used space in the stack */
   uint64_t *top;      /** Pointer to the "top" of the stack */
-  uint64_t *base;     /** Pointer to the base of the allocated region */
+  uint64_t *base;     /** Pointer to the base of the allocated region, right
+                       *  above the guard page */
 } l1_stack;
 
 /**
  * @brief Creates a new stack for a thread
  *
- * This function allocates space for and sets up a new stack of type 
- * `l1_stack` and of capacity MAX_STACK_CAPACITY.
+ * This function maps space for and sets up a new stack of type `l1_stack`,
+ * guard page included, of capacity a little below MAX_STACK_CAPACITY.
  *
  * @return  A pointer to the allocated stack. Returns NULL if unable
  *          to allocate space for the stack
@@ -36,10 +47,17 @@ l1_stack* l1_stack_new(void);
 /**
  * @brief Cleans up the stack for a thread on completion 
  * 
+ * The stack goes back to the pool if it has room, and is freed otherwise.
+ *
  * @param   thread_stack A pointer to the stack to be freed
  */
 void l1_stack_free(l1_stack* thread_stack);
 
+/**
+ * @brief Frees every stack kept in the pool
+ */
+void l1_stack_pool_drain(void);
+
 /**
  * @brief Check if the stack is full 
  *
@@ -9,12 +9,19 @@
 #include <stdbool.h>
 #include <time.h>
 #include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <pthread.h>
 #include "malloc.h"
 
 void *(*l1_malloc)(size_t) = libc_malloc;
 l1_error (*l1_free)(void *) = libc_free;
 void (*l1_init)(void) = NULL;
 void (*l1_deinit)(void) = NULL;
+void *(*l1_realloc)(void *, size_t) = libc_realloc;
+void *(*l1_calloc)(size_t, size_t) = libc_calloc;
+void *(*l1_memalign)(size_t, size_t) = libc_memalign;
 
 START_TEST(chunk_malloc_test_1) {
     /* This will test the chunk allocator */
@@ -44,6 +51,503 @@ START_TEST(list_malloc_test_1) {
 }
 END_TEST
 
+/* Test that free chunk runs are found across bitmap word boundaries */
+START_TEST(chunk_malloc_bitmap_test) {
+  l1_init = l1_chunk_init;
+  l1_deinit = l1_chunk_deinit;
+  l1_malloc = l1_chunk_malloc;
+  l1_free = l1_chunk_free;
+
+  l1_init();
+  /* Fill the arena with single-chunk regions */
+  void *regions[CHUNK_ARENA_LENGTH];
+  for (unsigned i = 0; i < CHUNK_ARENA_LENGTH; i++) {
+    regions[i] = l1_malloc(CHUNK_SIZE);
+    ck_assert_msg(regions[i] == l1_chunk_arena[i],
+                  "Regions should be handed out first-fit.");
+  }
+  ck_assert_msg(l1_malloc(CHUNK_SIZE) == l1_chunk_arena[CHUNK_ARENA_LENGTH],
+                "A full arena should grow by a segment.");
+
+  /* Free chunks 62-65, straddling the first word boundary */
+  for (unsigned i = 62; i <= 65; i++)
+    ck_assert_int_eq(l1_free(regions[i]), SUCCESS);
+  ck_assert_int_eq(l1_free(regions[62]), ERRINVAL);
+  ck_assert_msg(l1_malloc(4 * CHUNK_SIZE + 1)
+                == l1_chunk_arena[CHUNK_ARENA_LENGTH + 1],
+                "Five chunks should not fit in a run of four.");
+  ck_assert_msg(l1_malloc(4 * CHUNK_SIZE) == l1_chunk_arena[62],
+                "Four chunks should fit across the word boundary.");
+  l1_deinit();
+}
+END_TEST
+
+/* Test that small requests share slab chunks by size class */
+START_TEST(chunk_malloc_slab_test) {
+  l1_init = l1_chunk_init;
+  l1_deinit = l1_chunk_deinit;
+  l1_malloc = l1_chunk_malloc;
+  l1_free = l1_chunk_free;
+
+  l1_init();
+  char *a = l1_malloc(1);
+  char *b = l1_malloc(SLAB_MIN_SIZE);
+  char *c = l1_malloc(SLAB_MIN_SIZE + 1);
+  char *d = l1_malloc(SLAB_MAX_SIZE);
+  ck_assert_msg(a != NULL && b != NULL && c != NULL && d != NULL,
+                "Small allocations should succeed.");
+  ck_assert_msg(b - a == SLAB_MIN_SIZE,
+                "Objects of one size class should share a chunk.");
+  ck_assert_msg((c - l1_chunk_arena[0]) / CHUNK_SIZE
+                != (a - l1_chunk_arena[0]) / CHUNK_SIZE,
+                "Size classes should use separate slabs.");
+  ck_assert_msg((size_t)c % (2 * SLAB_MIN_SIZE) == 0
+                && (size_t)d % SLAB_MAX_SIZE == 0,
+                "Slab objects should be aligned to their size class.");
+
+  ck_assert_int_eq(l1_free(a + 1), ERRINVAL);
+  ck_assert_int_eq(l1_free(a), SUCCESS);
+  ck_assert_int_eq(l1_free(a), ERRINVAL);
+  ck_assert_msg(l1_malloc(SLAB_MIN_SIZE) == a, "Freed objects are reused.");
+  l1_deinit();
+}
+END_TEST
+
+/* Test buddy splitting and coalescing */
+START_TEST(buddy_malloc_test) {
+  l1_init = l1_buddy_init;
+  l1_deinit = l1_buddy_deinit;
+  l1_malloc = l1_buddy_malloc;
+  l1_free = l1_buddy_free;
+
+  l1_init();
+  ck_assert_msg(l1_malloc(0) == NULL, "A malloc of size 0 should return NULL.");
+  char *a = l1_malloc(1);
+  char *b = l1_malloc(BUDDY_MIN_SIZE + 1);
+  char *c = l1_malloc(BUDDY_MIN_SIZE);
+  ck_assert_msg(a == (char *)l1_chunk_arena, "First block starts the arena.");
+  ck_assert_msg(c == a + BUDDY_MIN_SIZE, "The buddy of a is handed out next.");
+  ck_assert_msg(b == a + 2 * BUDDY_MIN_SIZE, "Blocks are aligned to size.");
+  ck_assert_msg(l1_malloc(ALLOC8R_HEAP_SIZE) == NULL,
+                "The arena is no longer a single free block.");
+
+  ck_assert_int_eq(l1_free(a + 1), ERRINVAL);
+  ck_assert_int_eq(l1_free(a), SUCCESS);
+  ck_assert_int_eq(l1_free(a), ERRINVAL);
+  ck_assert_int_eq(l1_free(b), SUCCESS);
+  ck_assert_int_eq(l1_free(c), SUCCESS);
+  ck_assert_msg(l1_buddy_orders == 1u << BUDDY_MAX_ORDER,
+                "All buddies should have merged back.");
+  ck_assert_msg(l1_malloc(ALLOC8R_HEAP_SIZE) == a,
+                "The whole arena should be allocatable again.");
+  l1_deinit();
+}
+END_TEST
+
+/* Test that freed list regions coalesce back into the whole heap */
+START_TEST(list_malloc_coalesce_test) {
+  l1_init = l1_list_init;
+  l1_deinit = l1_list_deinit;
+  l1_malloc = l1_list_malloc;
+  l1_free = l1_list_free;
+
+  l1_mmap_threshold = SIZE_MAX;
+  l1_init();
+  void *live[128] = { NULL };
+  srand(323);
+  for (unsigned op = 0; op < 20000; op++) {
+    const unsigned slot = rand() % 128;
+    if (live[slot] != NULL) {
+      ck_assert_int_eq(l1_free(live[slot]), SUCCESS);
+      live[slot] = NULL;
+    } else {
+      live[slot] = l1_malloc(rand() % 8192 + 1);
+      ck_assert_msg(live[slot] != NULL, "Churn should not run out of memory.");
+    }
+  }
+  for (unsigned i = 0; i < 128; i++)
+    ck_assert_int_eq(l1_free(live[i]), SUCCESS);
+
+  ck_assert_msg(__builtin_popcountll(l1_list_bin_map) == 1,
+                "A single bin should hold free regions.");
+  l1_list_meta *head = l1_list_bins[__builtin_ctzll(l1_list_bin_map)];
+  const size_t capacity = l1_list_heap_size - LIST_HDR_SIZE - LIST_TAG_SIZE;
+  ck_assert_msg(head == l1_list_heap && head->next == NULL
+                && head->capacity == capacity,
+                "The free list should be a single region spanning the heap.");
+  void *all = l1_malloc(capacity);
+  ck_assert_msg(all != NULL, "The whole heap should be allocatable.");
+  ck_assert_int_eq(l1_free(all), SUCCESS);
+  ck_assert_int_eq(l1_free(all), ERRINVAL);
+  l1_deinit();
+  l1_mmap_threshold = ALLOC8R_MMAP_THRESHOLD;
+}
+END_TEST
+
+/** Helper function:
+ * Whether any page of [addr, addr + len) is resident
+ */
+static int resident(void *addr, size_t len)
+{
+  const size_t page = sysconf(_SC_PAGESIZE);
+  unsigned char vec[len / page];
+  ck_assert_int_eq(mincore(addr, len, vec), 0);
+  for (size_t i = 0; i < len / page; i++)
+    if (vec[i] & 1)
+      return 1;
+  return 0;
+}
+
+/* Test that both heaps grow by segments, and give empty segments back */
+START_TEST(segment_grow_test) {
+  const size_t segment = 64 * 1024;
+  l1_segment_size = segment;
+  l1_mmap_threshold = SIZE_MAX;
+
+  l1_chunk_init();
+  ck_assert_int_eq(l1_chunk_arena_length, segment / CHUNK_SIZE);
+  char *a = l1_chunk_malloc(segment);
+  char *b = l1_chunk_malloc(2 * segment);
+  ck_assert_msg(a == l1_chunk_arena[0] && b == a + segment,
+                "The arena should grow contiguously.");
+  ck_assert_int_eq(l1_chunk_arena_length, 3 * segment / CHUNK_SIZE);
+  memset(b, 1, 2 * segment);
+  ck_assert_int_eq(l1_chunk_free(b), SUCCESS);
+  ck_assert_msg(!resident(b, 2 * segment),
+                "Empty segments should be given back.");
+  ck_assert_msg(l1_chunk_malloc(2 * segment) == b, "Segments are reused.");
+  l1_chunk_deinit();
+
+  l1_list_init();
+  ck_assert_int_eq(l1_list_heap_size, segment);
+  char *c = l1_list_malloc(segment / 2);
+  char *d = l1_list_malloc(4 * segment);
+  ck_assert_msg(c != NULL && d > c, "The heap should grow past its segment.");
+  ck_assert_int_eq(l1_list_heap_size, 5 * segment);
+  memset(d, 1, 4 * segment);
+  ck_assert_int_eq(l1_list_free(d), SUCCESS);
+  ck_assert_msg(!resident((char *)l1_list_heap + segment, 3 * segment),
+                "Segments inside a free region should be given back.");
+  ck_assert_int_eq(l1_list_free(c), SUCCESS);
+  ck_assert_msg(l1_list_malloc(5 * segment - LIST_HDR_SIZE - LIST_TAG_SIZE)
+                == (char *)l1_list_heap + LIST_HDR_SIZE,
+                "The grown heap should coalesce into one region.");
+  l1_list_deinit();
+  l1_segment_size = ALLOC8R_HEAP_SIZE;
+  l1_mmap_threshold = ALLOC8R_MMAP_THRESHOLD;
+}
+END_TEST
+
+/* Test that huge requests are mapped on their own, outside both heaps */
+START_TEST(mmap_malloc_test) {
+  void (*const inits[])(void) = { l1_chunk_init, l1_list_init };
+  void (*const deinits[])(void) = { l1_chunk_deinit, l1_list_deinit };
+  void *(*const mallocs[])(size_t) = { l1_chunk_malloc, l1_list_malloc };
+  l1_error (*const frees[])(void *) = { l1_chunk_free, l1_list_free };
+  const size_t page = sysconf(_SC_PAGESIZE);
+
+  for (unsigned i = 0; i < 2; i++) {
+    inits[i]();
+    char *small = mallocs[i](ALLOC8R_MMAP_THRESHOLD);
+    char *huge = mallocs[i](ALLOC8R_MMAP_THRESHOLD + 1);
+    char *huger = mallocs[i](4 * ALLOC8R_HEAP_SIZE);
+    ck_assert_msg(small != NULL && huge != NULL && huger != NULL,
+                  "Huge allocations should succeed.");
+    ck_assert_msg(l1_mmap_head == (l1_mmap_hdr *)huger - 1
+                  && l1_mmap_head->next == (l1_mmap_hdr *)huge - 1,
+                  "Huge allocations should have a mapping each.");
+    ck_assert_msg((size_t)(huge - sizeof(l1_mmap_hdr)) % page == 0
+                  && (size_t)huge % sizeof(max_align_t) == 0,
+                  "The data should follow a header at the start of a page.");
+    memset(huger, 1, 4 * ALLOC8R_HEAP_SIZE);
+
+    int local;
+    ck_assert_int_eq(frees[i](&local), ERRINVAL);
+    ck_assert_int_eq(frees[i](huge), SUCCESS);
+    ck_assert_int_eq(frees[i](huge), ERRINVAL);
+    ck_assert_int_eq(frees[i](small), SUCCESS);
+    ck_assert_msg(l1_mmap_head == (l1_mmap_hdr *)huger - 1
+                  && l1_mmap_head->next == NULL,
+                  "Freed mappings should leave the list.");
+    deinits[i]();
+    ck_assert_msg(l1_mmap_head == NULL, "Deinit should unmap the rest.");
+  }
+}
+END_TEST
+
+/* Test in-place and copying chunk reallocation, and zeroed allocation */
+START_TEST(chunk_realloc_test) {
+  l1_chunk_init();
+  char *a = l1_chunk_realloc(NULL, CHUNK_SIZE);
+  char *fence = l1_chunk_malloc(CHUNK_SIZE);
+  ck_assert_msg(a == l1_chunk_arena[0] && fence == l1_chunk_arena[1],
+                "Regions are handed out first-fit.");
+  memset(a, 7, CHUNK_SIZE);
+  ck_assert_int_eq(l1_chunk_free(fence), SUCCESS);
+  ck_assert_msg(l1_chunk_realloc(a, 3 * CHUNK_SIZE) == a,
+                "A region should grow over the free chunks after it.");
+  ck_assert_msg(l1_chunk_realloc(a, CHUNK_SIZE + 1) == a,
+                "A region should shrink in place.");
+  ck_assert_msg(IS_CHUNK_TAKEN(1) && IS_CHUNK_FREE(2),
+                "Shrinking should free the trailing chunks.");
+
+  fence = l1_chunk_malloc(CHUNK_SIZE);
+  ck_assert_msg(fence == l1_chunk_arena[2], "Freed chunks are reused.");
+  char *b = l1_chunk_realloc(a, 3 * CHUNK_SIZE);
+  ck_assert_msg(b != a && b[0] == 7 && b[CHUNK_SIZE - 1] == 7,
+                "A blocked region should be copied.");
+  ck_assert_int_eq(l1_chunk_free(a), ERRINVAL);
+
+  char *small = l1_chunk_realloc(NULL, 20);
+  ck_assert_msg(l1_chunk_realloc(small, 2 * SLAB_MIN_SIZE) == small,
+                "A slab object fitting its size class should stay.");
+  ck_assert_msg(l1_chunk_realloc(small + 1, 1) == NULL
+                && l1_errno == ERRINVAL, "Interior pointers are rejected.");
+  char *huge = l1_chunk_realloc(b, 2 * ALLOC8R_MMAP_THRESHOLD);
+  ck_assert_msg(huge[0] == 7 && l1_mmap_head == (l1_mmap_hdr *)huge - 1,
+                "Growing past the threshold should move to a mapping.");
+  huge = l1_chunk_realloc(huge, 16 * ALLOC8R_MMAP_THRESHOLD);
+  ck_assert_msg(huge[0] == 7, "Mappings should be resized.");
+  ck_assert_msg(l1_chunk_realloc(huge, 0) == NULL && l1_mmap_head == NULL,
+                "A size of 0 should free.");
+
+  unsigned *zeroed = l1_chunk_calloc(CHUNK_SIZE, sizeof(unsigned));
+  for (unsigned i = 0; i < CHUNK_SIZE; i++)
+    ck_assert_uint_eq(zeroed[i], 0);
+  ck_assert_msg(l1_chunk_calloc(SIZE_MAX, 2) == NULL && l1_errno == ERRNOMEM,
+                "Overflowing sizes should fail.");
+  l1_chunk_deinit();
+}
+END_TEST
+
+/* Test in-place and copying list reallocation, and zeroed allocation */
+START_TEST(list_realloc_test) {
+  l1_list_init();
+  char *a = l1_list_malloc(100);
+  char *fence = l1_list_malloc(100);
+  memset(a, 7, 100);
+  ck_assert_int_eq(l1_list_free(fence), SUCCESS);
+  ck_assert_msg(l1_list_realloc(a, 1000) == a,
+                "A region should grow over the free region after it.");
+  ck_assert_msg(l1_list_realloc(a, 64) == a, "A region should shrink in place.");
+  fence = l1_list_malloc(64);
+  ck_assert_msg(fence == a + 64 + LIST_TAG_SIZE + LIST_HDR_SIZE,
+                "Shrinking should give the tail back.");
+
+  char *b = l1_list_realloc(a, 1000);
+  ck_assert_msg(b != a && b[0] == 7 && b[63] == 7,
+                "A blocked region should be copied.");
+  ck_assert_int_eq(l1_list_free(a), ERRINVAL);
+
+  char *huge = l1_list_realloc(b, 2 * ALLOC8R_MMAP_THRESHOLD);
+  ck_assert_msg(huge[0] == 7 && l1_mmap_head == (l1_mmap_hdr *)huge - 1,
+                "Growing past the threshold should move to a mapping.");
+  ck_assert_int_eq(l1_list_free(huge), SUCCESS);
+
+  unsigned *zeroed = l1_list_calloc(1000, sizeof(unsigned));
+  for (unsigned i = 0; i < 1000; i++)
+    ck_assert_uint_eq(zeroed[i], 0);
+  ck_assert_msg(l1_list_calloc(2, SIZE_MAX) == NULL && l1_errno == ERRNOMEM,
+                "Overflowing sizes should fail.");
+  l1_list_deinit();
+
+  /* A region ending the heap grows it in place */
+  l1_segment_size = 64 * 1024;
+  l1_list_init();
+  char *last = l1_list_malloc(l1_segment_size - LIST_HDR_SIZE - LIST_TAG_SIZE);
+  ck_assert_msg(l1_list_realloc(last, 3 * l1_segment_size) == last,
+                "The last region should grow with the heap.");
+  ck_assert_int_eq(l1_list_heap_size, 4 * l1_segment_size);
+  l1_list_deinit();
+  l1_segment_size = ALLOC8R_HEAP_SIZE;
+}
+END_TEST
+
+/* Test aligned allocation from both allocators */
+START_TEST(memalign_test) {
+  const size_t alignments[] = { 64, 1024, CHUNK_SIZE, 16 * CHUNK_SIZE };
+  const size_t sizes[] = { 1, 100, 3000, 3 * CHUNK_SIZE };
+
+  l1_chunk_init();
+  for (unsigned a = 0; a < 4; a++) {
+    for (unsigned i = 0; i < 4; i++) {
+      char *ptr = l1_chunk_memalign(alignments[a], sizes[i]);
+      ck_assert_msg(ptr != NULL && (size_t)ptr % alignments[a] == 0,
+                    "Allocations should be aligned.");
+      memset(ptr, 1, sizes[i]);
+      ck_assert_int_eq(l1_chunk_free(ptr), SUCCESS);
+    }
+  }
+  /* Emptied slabs may keep a chunk each */
+  size_t taken = 0;
+  for (size_t i = 0; i < l1_chunk_arena_length; i++)
+    taken -= IS_CHUNK_TAKEN(i);
+  char *aligned = l1_chunk_memalign(16 * CHUNK_SIZE, CHUNK_SIZE);
+  for (size_t i = 0; i < l1_chunk_arena_length; i++)
+    taken += IS_CHUNK_TAKEN(i);
+  ck_assert_msg(taken == 1 && (size_t)aligned % (16 * CHUNK_SIZE) == 0,
+                "An aligned run should not waste chunks.");
+  ck_assert_int_eq(l1_chunk_free(aligned), SUCCESS);
+  char *huge = l1_chunk_memalign(4 * ALLOC8R_HEAP_SIZE, 2 * ALLOC8R_MMAP_THRESHOLD);
+  ck_assert_msg((size_t)huge % (4 * ALLOC8R_HEAP_SIZE) == 0,
+                "Huge allocations should be aligned.");
+  memset(huge, 1, 2 * ALLOC8R_MMAP_THRESHOLD);
+  ck_assert_int_eq(l1_chunk_free(huge), SUCCESS);
+  ck_assert_msg(l1_chunk_memalign(48, 1) == NULL && l1_errno == ERRINVAL,
+                "Alignments must be powers of two.");
+  l1_chunk_deinit();
+
+  l1_list_init();
+  void *live[16];
+  for (unsigned a = 0; a < 4; a++) {
+    for (unsigned i = 0; i < 4; i++) {
+      live[a * 4 + i] = l1_list_memalign(alignments[a], sizes[i]);
+      ck_assert_msg(live[a * 4 + i] != NULL
+                    && (size_t)live[a * 4 + i] % alignments[a] == 0,
+                    "Allocations should be aligned.");
+      memset(live[a * 4 + i], 1, sizes[i]);
+    }
+  }
+  for (unsigned i = 0; i < 16; i++)
+    ck_assert_int_eq(l1_list_free(live[i]), SUCCESS);
+  ck_assert_msg(__builtin_popcountll(l1_list_bin_map) == 1
+                && l1_list_bins[__builtin_ctzll(l1_list_bin_map)]
+                   == l1_list_heap,
+                "Leading gaps should coalesce back into the heap.");
+  ck_assert_msg(l1_list_memalign(2, 1) == NULL && l1_errno == ERRINVAL,
+                "Alignments must be at least a pointer.");
+  l1_list_deinit();
+}
+END_TEST
+
+#define MT_THREADS 4
+#define MT_OBJECTS 20000
+
+static void *mt_handoff[MT_THREADS][MT_OBJECTS];
+
+/** Helper function:
+ * Allocates objects for the next thread, then frees the ones handed off by
+ * the previous thread
+ */
+static void *mt_worker(void *arg) {
+  const unsigned self = (unsigned)(size_t)arg;
+  unsigned seed = self;
+  for (unsigned i = 0; i < MT_OBJECTS; i++) {
+    const size_t size = rand_r(&seed) % 3000 + 1;
+    mt_handoff[self][i] = l1_mt_malloc(size);
+    ck_assert_ptr_nonnull(mt_handoff[self][i]);
+    memset(mt_handoff[self][i], self, size);
+  }
+  return NULL;
+}
+
+static void *mt_freer(void *arg) {
+  const unsigned self = (unsigned)(size_t)arg;
+  const unsigned prev = (self + MT_THREADS - 1) % MT_THREADS;
+  for (unsigned i = 0; i < MT_OBJECTS; i++)
+    ck_assert_int_eq(l1_mt_free(mt_handoff[prev][i]), SUCCESS);
+  return NULL;
+}
+
+/* Test cross-thread frees, and that exiting threads flush their caches */
+START_TEST(mt_malloc_test) {
+  pthread_t threads[MT_THREADS];
+
+  l1_mt_init();
+  for (size_t i = 0; i < MT_THREADS; i++)
+    pthread_create(&threads[i], NULL, mt_worker, (void *)i);
+  for (size_t i = 0; i < MT_THREADS; i++)
+    pthread_join(threads[i], NULL);
+  for (size_t i = 0; i < MT_THREADS; i++)
+    pthread_create(&threads[i], NULL, mt_freer, (void *)i);
+  for (size_t i = 0; i < MT_THREADS; i++)
+    pthread_join(threads[i], NULL);
+
+  ck_assert_msg(__builtin_popcountll(l1_list_bin_map) == 1
+                && l1_list_bins[__builtin_ctzll(l1_list_bin_map)]
+                   == l1_list_heap,
+                "Every cached block should be back in the central heap.");
+  l1_mt_deinit();
+}
+END_TEST
+
+#ifdef L1_ALLOC_STATS
+/* Test the statistics of both allocators */
+START_TEST(alloc_stats_test) {
+  l1_alloc_stats_t stats;
+
+  l1_chunk_init();
+  char *small = l1_chunk_malloc(100);
+  char *region = l1_chunk_malloc(3 * CHUNK_SIZE);
+  ck_assert_int_eq(l1_chunk_free(small), SUCCESS);
+  ck_assert_int_eq(l1_chunk_free(small), ERRINVAL);
+  ck_assert_ptr_null(l1_chunk_memalign(3, 1));
+  ck_assert_int_eq(l1_alloc_stats(L1_CHUNK, &stats), SUCCESS);
+  ck_assert_uint_eq(stats.in_use, 3 * CHUNK_SIZE);
+  ck_assert_uint_eq(stats.peak, 3 * CHUNK_SIZE + 128);
+  ck_assert_uint_eq(stats.allocs, 3);
+  ck_assert_uint_eq(stats.frees, 2);
+  ck_assert_uint_eq(stats.failures, 1);
+  ck_assert_uint_eq(stats.class_allocs[7], 1);
+  ck_assert_uint_eq(stats.class_allocs[14], 1);
+  region = l1_chunk_realloc(region, CHUNK_SIZE);
+  ck_assert_int_eq(l1_alloc_stats(L1_CHUNK, &stats), SUCCESS);
+  ck_assert_uint_eq(stats.in_use, CHUNK_SIZE);
+  ck_assert_uint_eq(stats.reallocs, 1);
+  /* Overflowing callocs and failed reallocs count as failures */
+  ck_assert_ptr_null(l1_chunk_calloc((size_t)1 << 32, (size_t)1 << 32));
+  ck_assert_ptr_null(l1_chunk_realloc(region, SIZE_MAX / 2));
+  ck_assert_int_eq(l1_alloc_stats(L1_CHUNK, &stats), SUCCESS);
+  ck_assert_uint_eq(stats.in_use, CHUNK_SIZE);
+  ck_assert_uint_eq(stats.reallocs, 2);
+  ck_assert_uint_eq(stats.failures, 3);
+  l1_chunk_deinit();
+
+  l1_list_init();
+  void *a = l1_list_malloc(1000);
+  void *b = l1_list_malloc(1000);
+  void *c = l1_list_malloc(1000);
+  ck_assert_int_eq(l1_list_free(b), SUCCESS);
+  ck_assert_int_eq(l1_alloc_stats(L1_LIST, &stats), SUCCESS);
+  ck_assert_uint_eq(stats.in_use, 2 * 1024);
+  ck_assert_uint_eq(stats.free_regions, 2);
+  ck_assert_msg(stats.largest_free > 1024 && stats.fragmentation > 0
+                && stats.fragmentation < 0.01,
+                "A small hole should barely fragment the heap.");
+  ck_assert_int_eq(l1_list_free(a), SUCCESS);
+  ck_assert_int_eq(l1_list_free(c), SUCCESS);
+  ck_assert_int_eq(l1_alloc_stats(L1_LIST, &stats), SUCCESS);
+  ck_assert_msg(stats.in_use == 0 && stats.peak == 3 * 1024
+                && stats.free_regions == 1 && stats.fragmentation == 0,
+                "The heap should be a single free region again.");
+  l1_list_deinit();
+}
+END_TEST
+#endif
+
+/* Test that freed regions are reused from their size bin */
+START_TEST(list_malloc_bins_test) {
+  l1_init = l1_list_init;
+  l1_deinit = l1_list_deinit;
+  l1_malloc = l1_list_malloc;
+  l1_free = l1_list_free;
+
+  l1_init();
+  void *small = l1_malloc(64);
+  void *fence0 = l1_malloc(1);
+  void *big = l1_malloc(4000);
+  void *fence1 = l1_malloc(1);
+  ck_assert_int_eq(l1_free(small), SUCCESS);
+  ck_assert_int_eq(l1_free(big), SUCCESS);
+
+  ck_assert_msg(l1_malloc(3000) == big, "The best fitting region is reused.");
+  ck_assert_msg(l1_malloc(64) == small, "Exact-size bins are reused.");
+  ck_assert_int_eq(l1_free(fence0), SUCCESS);
+  ck_assert_int_eq(l1_free(fence1), SUCCESS);
+  l1_deinit();
+}
+END_TEST
+
 START_TEST(magic_equals_test) {
   max_align_t magic_number;
   srand(time(NULL));
@@ -70,6 +574,20 @@ int main(int argc, char **argv)
 
   /* Add more tests of your own */
   tcase_add_test(tc1, magic_equals_test);
+  tcase_add_test(tc1, chunk_malloc_bitmap_test);
+  tcase_add_test(tc1, chunk_malloc_slab_test);
+  tcase_add_test(tc1, buddy_malloc_test);
+  tcase_add_test(tc1, list_malloc_coalesce_test);
+  tcase_add_test(tc1, list_malloc_bins_test);
+  tcase_add_test(tc1, segment_grow_test);
+  tcase_add_test(tc1, mmap_malloc_test);
+  tcase_add_test(tc1, chunk_realloc_test);
+  tcase_add_test(tc1, list_realloc_test);
+  tcase_add_test(tc1, memalign_test);
+  tcase_add_test(tc1, mt_malloc_test);
+#ifdef L1_ALLOC_STATS
+  tcase_add_test(tc1, alloc_stats_test);
+#endif
 
   SRunner *sr = srunner_create(s); 
   srunner_run_all(sr, CK_VERBOSE); 
@@ -6,11 +6,192 @@
 
 #include <check.h>
 #include <stdlib.h>
+#include <string.h>
+#include "schedule.h"
+#include "sched_policy.h"
+
+/* Builds `n` runnable threads at the given levels, off the scheduler lists */
+static void make_threads(l1_thread_info *threads, const l1_priority *levels,
+                         int n) {
+    memset(threads, 0, n * sizeof(l1_thread_info));
+    for (int i = 0; i < n; i++) {
+        threads[i].id = i;
+        threads[i].state = RUNNABLE;
+        threads[i].priority_level = levels[i];
+    }
+}
+
+START_TEST(mlfq_queue_order_test) {
+    // The highest level goes first, and threads of a level go in the order
+    // they were queued.
+    const l1_priority levels[] = { 3, 7, 7, 5 };
+    l1_thread_info threads[4];
+    clean_up_scheduler();
+    initialize_scheduler(l1_mlfq_policy);
+    l1_scheduler_info *sched = get_scheduler();
+    sched->sched_ticks = 1; /* No boost */
+    make_threads(threads, levels, 4);
+    for (int i = 0; i < 4; i++)
+        l1_mlfq_enqueue(&threads[i]);
+
+    const int expected[] = { 1, 2, 3, 0 };
+    for (int i = 0; i < 4; i++) {
+        l1_thread_info *next = l1_mlfq_policy(sched->tsys, NULL);
+        ck_assert_msg(next == &threads[expected[i]],
+                      "MLFQ should pick the oldest thread of the top level.");
+    }
+    ck_assert_msg(l1_mlfq_policy(sched->tsys, NULL) == NULL,
+                  "MLFQ should have nothing left to pick.");
+}
+END_TEST
+
+START_TEST(mlfq_boost_test) {
+    // A boost moves every queued thread up a level, merging the level below
+    // the top into the top after the threads already there.
+    const l1_priority levels[] = { TOP_PRIORITY - 1, TOP_PRIORITY, 3 };
+    l1_thread_info threads[3];
+    clean_up_scheduler();
+    initialize_scheduler(l1_mlfq_policy);
+    l1_scheduler_info *sched = get_scheduler();
+    make_threads(threads, levels, 3);
+    for (int i = 0; i < 3; i++)
+        l1_mlfq_enqueue(&threads[i]);
+
+    sched->sched_ticks = 0; /* Boost on this decision */
+    ck_assert_msg(l1_mlfq_policy(sched->tsys, NULL) == &threads[1],
+                  "The top level should keep its order on a boost.");
+    sched->sched_ticks = 1;
+    ck_assert_msg(l1_mlfq_policy(sched->tsys, NULL) == &threads[0]
+                  && threads[0].priority_level == TOP_PRIORITY,
+                  "The level below the top should be boosted to the top.");
+    ck_assert_msg(l1_mlfq_policy(sched->tsys, NULL) == &threads[2]
+                  && threads[2].priority_level == 4,
+                  "Lower levels should be boosted by one.");
+}
+END_TEST
+
+START_TEST(rbtree_order_test) {
+    // Popping the first node returns the threads sorted by vruntime, after
+    // random insertions and removals.
+    enum { N = 2000 };
+    l1_thread_info *threads = calloc(N, sizeof(l1_thread_info));
+    l1_scheduler_info *sched;
+    clean_up_scheduler();
+    initialize_scheduler(l1_cfs_policy);
+    sched = get_scheduler();
+    srand(N);
+    for (int i = 0; i < N; i++) {
+        threads[i].id = i;
+        threads[i].vruntime = rand() % 64;
+        l1_cfs_enqueue(&threads[i]);
+        /* Churn: take out and put back a random queued thread */
+        if (i % 3 == 2) {
+            l1_thread_info *t = &threads[rand() % (i + 1)];
+            rb_erase(&sched->cfs.tree, &t->rq_node);
+            l1_cfs_enqueue(t);
+        }
+    }
+    ck_assert_msg(sched->cfs.tree.size == N, "Every thread should be queued.");
+    l1_thread_info *last = NULL;
+    for (int i = 0; i < N; i++) {
+        l1_rb_node *first = rb_first(&sched->cfs.tree);
+        ck_assert_msg(first != NULL, "The tree should not run out early.");
+        l1_thread_info *t = rb_entry(first, l1_thread_info, rq_node);
+        ck_assert_msg(last == NULL || last->vruntime <= t->vruntime,
+                      "Threads should come out by vruntime.");
+        rb_erase(&sched->cfs.tree, first);
+        last = t;
+    }
+    ck_assert_msg(rb_first(&sched->cfs.tree) == NULL, "The tree should be empty.");
+    free(threads);
+}
+END_TEST
+
+START_TEST(cfs_weight_test) {
+    // Two always-runnable threads at the top and bottom priorities share the
+    // CPU in the ratio of their weights.
+    const l1_priority levels[] = { TOP_PRIORITY, LOWEST_PRIORITY };
+    l1_thread_info threads[2];
+    int runs[2] = { 0, 0 };
+    clean_up_scheduler();
+    initialize_scheduler(l1_cfs_policy);
+    l1_scheduler_info *sched = get_scheduler();
+    make_threads(threads, levels, 2);
+    for (int i = 0; i < 2; i++)
+        l1_cfs_enqueue(&threads[i]);
+
+    l1_thread_info *prev = sched->tsys;
+    for (int i = 0; i < 10000; i++) {
+        if (prev != sched->tsys) {
+            /* Every slice lasts 1000 time units, and prev stays runnable */
+            prev->slice_start = 0;
+            prev->slice_end = 1000;
+            l1_cfs_enqueue(prev);
+        }
+        prev = l1_cfs_policy(prev, NULL);
+        runs[prev - threads]++;
+    }
+    const double ratio = (double)runs[0] / runs[1];
+    const double expected = (double)l1_priority_weight(TOP_PRIORITY)
+                            / l1_priority_weight(LOWEST_PRIORITY);
+    ck_assert_msg(ratio > 0.95 * expected && ratio < 1.05 * expected,
+                  "CPU shares should follow the weights.");
+}
+END_TEST
+
+START_TEST(timer_wheel_test) {
+    // Timers spread over every level expire in deadline order, neither
+    // before their deadline nor more than a tick after it, while the time
+    // advances by irregular steps.
+    enum { N = 2000 };
+    const l1_time tick = (l1_time)1 << TIMER_TICK_SHIFT;
+    static l1_timer timers[N];
+    static l1_timer_wheel wheel;
+    static int done[N];
+    memset(&wheel, 0, sizeof(wheel));
+    memset(done, 0, sizeof(done));
+    srand(42);
+    for (int i = 0; i < N; i++) {
+        /* From a few ticks to past the span of the top level */
+        const int shift = TIMER_TICK_SHIFT + rand() % (TIMER_LEVELS * TIMER_SLOT_BITS + 2);
+        timer_wheel_add(&wheel, &timers[i], 1 + (((l1_time)rand() << 32 | rand()) % ((l1_time)1 << shift)));
+    }
+    /* Cancelled timers never expire */
+    for (int i = 0; i < N; i += 10)
+        timer_wheel_del(&wheel, &timers[i]);
+
+    l1_time now = 0;
+    int expired = 0;
+    while (wheel.count > 0) {
+        l1_time when;
+        ck_assert_msg(timer_wheel_next(&wheel, &when) && when >= now,
+                      "The next expiry should not be in the past.");
+        /* Either jump to the next expiry or step by a few ticks */
+        now = (rand() % 2) ? when : now + (rand() % 8) * tick;
+        for (l1_timer *t = timer_wheel_expire(&wheel, now); t != NULL; t = t->next) {
+            ck_assert_msg((t - timers) % 10 != 0, "Cancelled timers should not expire.");
+            ck_assert_msg(t->deadline <= now, "Timers should not expire early.");
+            done[t - timers] = 1;
+            expired++;
+        }
+        for (int i = 1; i < N; i++)
+            ck_assert_msg(i % 10 == 0 || done[i] || timers[i].deadline + tick > now,
+                          "Timers should expire within a tick.");
+    }
+    ck_assert_msg(expired == N - N / 10, "Every timer should expire once.");
+}
+END_TEST
 
 int main(int argc, char **argv) {
     Suite* s = suite_create("Threading lab");
     TCase *tc1 = tcase_create("basic"); 
+    suite_add_tcase(s, tc1);
     /* Your code here to test scheduling policies */
+    tcase_add_test(tc1, mlfq_queue_order_test);
+    tcase_add_test(tc1, mlfq_boost_test);
+    tcase_add_test(tc1, rbtree_order_test);
+    tcase_add_test(tc1, cfs_weight_test);
+    tcase_add_test(tc1, timer_wheel_test);
 
     SRunner *sr = srunner_create(s); 
     srunner_run_all(sr, CK_VERBOSE); 
@@ -5,8 +5,17 @@
  * @author Mark Sutherland
  */
 #include <check.h>
+#include <stdio.h>
 #include <stdlib.h> 
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include "l1_io.h"
+#include "preempt.h"
 #include "sched_policy.h"
+#include "thread.h"
 int global_executed = 0;
 
 void* thread_execute(void* arg) {
@@ -28,6 +37,474 @@ START_TEST(thread_executed_test) {
 }
 END_TEST
 
+void* thread_identity(void* arg) {
+    return arg;
+}
+
+int recycle_ok = 0;
+
+void* thread_recycle_root(void* arg) {
+    l1_tid tids[8];
+    for (uintptr_t round = 0; round < 1000; round++) {
+        for (uintptr_t i = 0; i < 8; i++)
+            l1_thread_create(&tids[i], thread_identity, (void*)(round * 8 + i));
+        for (uintptr_t i = 0; i < 8; i++) {
+            void* ret = NULL;
+            if (l1_thread_join(tids[i], &ret) != SUCCESS || ret != (void*)(round * 8 + i))
+                return NULL;
+        }
+    }
+    recycle_ok = 1;
+    return NULL;
+}
+
+START_TEST(thread_recycle_test) {
+  // Threads reuse the info structs and stacks of joined threads. Every
+  // recycled thread must still run its own routine with its own argument.
+  recycle_ok = 0;
+  clean_up_scheduler();
+  initialize_scheduler(l1_round_robin_policy);
+  l1_tid root;
+  l1_thread_create(&root, thread_recycle_root, NULL);
+  schedule();
+  ck_assert_msg(recycle_ok == 1, "Recycled threads should return their own argument.");
+}
+END_TEST
+
+l1_tid pingpong[2];
+char pingpong_log[16];
+unsigned pingpong_len = 0;
+
+void* thread_pingpong(void* arg) {
+    const int me = (int)(uintptr_t)arg;
+    for (int i = 0; i < 4; i++) {
+        pingpong_log[pingpong_len++] = 'a' + me;
+        yield(pingpong[!me]);
+    }
+    return NULL;
+}
+
+START_TEST(direct_yield_test) {
+  // A targeted yield switches straight to its target, so two threads
+  // yielding to each other must strictly alternate.
+  pingpong_len = 0;
+  memset(pingpong_log, 0, sizeof(pingpong_log));
+  clean_up_scheduler();
+  initialize_scheduler(l1_round_robin_policy);
+  l1_thread_create(&pingpong[0], thread_pingpong, (void*)0);
+  l1_thread_create(&pingpong[1], thread_pingpong, (void*)1);
+  schedule();
+  ck_assert_msg(strcmp(pingpong_log, "abababab") == 0,
+                "Threads yielding to each other should alternate.");
+}
+END_TEST
+
+int join_order_ok = 0;
+
+void* thread_join_order_root(void* arg) {
+    l1_tid tids[1000];
+    for (uintptr_t i = 0; i < 1000; i++)
+        l1_thread_create(&tids[i], thread_identity, (void*)i);
+    /* Join from the last thread created back to the first */
+    for (uintptr_t i = 1000; i-- > 0;) {
+        void* ret = NULL;
+        if (l1_thread_join(tids[i], &ret) != SUCCESS || ret != (void*)i)
+            return NULL;
+    }
+    /* A thread that was joined is gone */
+    if (l1_thread_join(tids[500], NULL) != ERRINVAL)
+        return NULL;
+    join_order_ok = 1;
+    return NULL;
+}
+
+START_TEST(join_order_test) {
+  // Joins look their target up by ID, whatever the order of the threads.
+  join_order_ok = 0;
+  clean_up_scheduler();
+  initialize_scheduler(l1_round_robin_policy);
+  l1_tid root;
+  l1_thread_create(&root, thread_join_order_root, NULL);
+  schedule();
+  ck_assert_msg(join_order_ok == 1, "Joins in any order should find their target.");
+}
+END_TEST
+
+l1_tid join_target;
+l1_error joiner_errors[2];
+void* joiner_values[2];
+
+void* thread_join_target(void* arg) {
+    /* Let both joiners block first */
+    yield(-1);
+    yield(-1);
+    return arg;
+}
+
+void* thread_joiner(void* arg) {
+    const int me = (int)(uintptr_t)arg;
+    joiner_errors[me] = l1_thread_join(join_target, &joiner_values[me]);
+    return NULL;
+}
+
+START_TEST(extra_joiner_test) {
+  // Only the first thread to join gets the return value; any further
+  // joiner of the same thread fails with ERRINVAL.
+  clean_up_scheduler();
+  initialize_scheduler(l1_round_robin_policy);
+  joiner_values[0] = joiner_values[1] = NULL;
+  l1_tid joiners[2];
+  l1_thread_create(&join_target, thread_join_target, (void*)42);
+  l1_thread_create(&joiners[0], thread_joiner, (void*)0);
+  l1_thread_create(&joiners[1], thread_joiner, (void*)1);
+  schedule();
+  ck_assert_msg(joiner_errors[0] == SUCCESS && joiner_values[0] == (void*)42,
+                "The first joiner should get the return value.");
+  ck_assert_msg(joiner_errors[1] == ERRINVAL && joiner_values[1] == NULL,
+                "An extra joiner should fail with ERRINVAL.");
+}
+END_TEST
+
+#define IDLE_THREADS 100000
+
+unsigned idle_threads = 0;
+long idle_rss_kb = -1;
+
+/* Resident set size of the process, in KiB */
+long rss_kb(void) {
+    char line[128];
+    long kb = -1;
+    FILE* status = fopen("/proc/self/status", "r");
+    if (status == NULL)
+        return -1;
+    while (fgets(line, sizeof(line), status) != NULL)
+        if (strncmp(line, "VmRSS:", 6) == 0)
+            kb = strtol(line + 6, NULL, 10);
+    fclose(status);
+    return kb;
+}
+
+void* thread_idle(void* arg) {
+    yield(-1);
+    return arg;
+}
+
+void* thread_idle_root(void* arg) {
+    l1_tid* tids = malloc(idle_threads * sizeof(l1_tid));
+    if (tids == NULL)
+        return NULL;
+    const long before = rss_kb();
+    for (unsigned i = 0; i < idle_threads; i++)
+        if (l1_thread_create(&tids[i], thread_idle, NULL) != SUCCESS)
+            return NULL;
+    /* Every thread runs once and parks in yield */
+    yield(-1);
+    idle_rss_kb = rss_kb() - before;
+    for (unsigned i = 0; i < idle_threads; i++)
+        l1_thread_join(tids[i], NULL);
+    free(tids);
+    return NULL;
+}
+
+START_TEST(idle_threads_rss_test) {
+  // Stacks are mostly-unused reservations, so idle threads must only cost
+  // the pages they touched. Each stack and its guard page are two mappings,
+  // so the thread count is capped by vm.max_map_count.
+  unsigned long max_maps = 65530;
+  FILE* f = fopen("/proc/sys/vm/max_map_count", "r");
+  if (f != NULL) {
+    if (fscanf(f, "%lu", &max_maps) != 1)
+      max_maps = 65530;
+    fclose(f);
+  }
+  idle_threads = IDLE_THREADS;
+  if (idle_threads > (max_maps - 1024) / 2)
+    idle_threads = (max_maps - 1024) / 2;
+
+  idle_rss_kb = -1;
+  clean_up_scheduler();
+  initialize_scheduler(l1_round_robin_policy);
+  l1_tid root;
+  l1_thread_create(&root, thread_idle_root, NULL);
+  schedule();
+  printf("%u idle threads: %ld KiB resident, %.1f KiB per thread\n",
+         idle_threads, idle_rss_kb, (double)idle_rss_kb / idle_threads);
+  ck_assert_msg(idle_rss_kb >= 0, "All idle threads should be created.");
+  ck_assert_msg(idle_rss_kb <= 16L * idle_threads,
+                "An idle thread should cost a few pages at most.");
+}
+END_TEST
+
+#define HOG_THREADS 4
+#define HOG_RUN_NS 200000000ull
+#define INTERACTIVE_THREADS 2
+#define INTERACTIVE_ROUNDS 50
+
+uint64_t preempt_max_latency_ns = 0;
+uint64_t preempt_sum_latency_ns = 0;
+unsigned preempt_samples = 0;
+
+uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void* thread_hog(void* arg) {
+    /* Spins without ever yielding */
+    const uint64_t end = monotonic_ns() + HOG_RUN_NS;
+    while (monotonic_ns() < end)
+        ;
+    return NULL;
+}
+
+void* thread_interactive(void* arg) {
+    /* Measures how long each yield keeps it away from the CPU */
+    for (int i = 0; i < INTERACTIVE_ROUNDS; i++) {
+        const uint64_t start = monotonic_ns();
+        yield(-1);
+        const uint64_t latency = monotonic_ns() - start;
+        if (latency > preempt_max_latency_ns)
+            preempt_max_latency_ns = latency;
+        preempt_sum_latency_ns += latency;
+        preempt_samples++;
+    }
+    return NULL;
+}
+
+START_TEST(preempt_latency_test) {
+  // Threads spinning for HOG_RUN_NS each are preempted at the end of their
+  // slices, so threads that keep yielding get the CPU back within a few
+  // slices instead of after every spinning thread is done.
+  preempt_max_latency_ns = preempt_sum_latency_ns = 0;
+  preempt_samples = 0;
+  l1_preemptions = 0;
+  clean_up_scheduler();
+  initialize_scheduler(l1_round_robin_policy);
+  l1_tid tid;
+  for (int i = 0; i < HOG_THREADS; i++)
+    l1_thread_create(&tid, thread_hog, NULL);
+  for (int i = 0; i < INTERACTIVE_THREADS; i++)
+    l1_thread_create(&tid, thread_interactive, NULL);
+  l1_preempt_tick = MIN_SLICE;
+  schedule();
+  l1_preempt_tick = 0;
+  printf("interactive latency over %u yields: mean %.2f ms, max %.2f ms, "
+         "%lu preemptions\n", preempt_samples,
+         preempt_sum_latency_ns / 1e6 / preempt_samples,
+         preempt_max_latency_ns / 1e6, (unsigned long)l1_preemptions);
+  ck_assert_msg(preempt_samples == INTERACTIVE_THREADS * INTERACTIVE_ROUNDS,
+                "Interactive threads should run to completion.");
+  ck_assert_msg(preempt_max_latency_ns < HOG_RUN_NS / 4,
+                "Spinning threads should be preempted.");
+}
+END_TEST
+
+int masked_ran = 0;
+int masked_ok = 0;
+
+void* thread_masked_witness(void* arg) {
+    masked_ran = 1;
+    return NULL;
+}
+
+void* thread_masked(void* arg) {
+    /* Spins over many slices with preemption masked, then unmasked */
+    l1_preempt_disable();
+    uint64_t end = monotonic_ns() + 20 * MIN_SLICE;
+    while (monotonic_ns() < end)
+        ;
+    masked_ok = !masked_ran;
+    l1_preempt_enable();
+    end = monotonic_ns() + 100 * MIN_SLICE;
+    while (!masked_ran && monotonic_ns() < end)
+        ;
+    return NULL;
+}
+
+START_TEST(preempt_mask_test) {
+  // A thread masking preemption keeps the CPU past its slice, and loses it
+  // once it unmasks.
+  masked_ran = masked_ok = 0;
+  clean_up_scheduler();
+  initialize_scheduler(l1_round_robin_policy);
+  l1_tid tid;
+  l1_thread_create(&tid, thread_masked, NULL);
+  l1_thread_create(&tid, thread_masked_witness, NULL);
+  l1_preempt_tick = MIN_SLICE;
+  schedule();
+  l1_preempt_tick = 0;
+  ck_assert_msg(masked_ok, "A masked thread should not be preempted.");
+  ck_assert_msg(masked_ran, "An unmasked thread should be preempted.");
+}
+END_TEST
+
+#define SLEEPERS 5
+
+int sleep_order[SLEEPERS];
+int sleep_woken = 0;
+int sleep_early = 0;
+
+void* thread_sleeper(void* arg) {
+    const int rank = (int)(uintptr_t)arg;
+    const uint64_t deadline = monotonic_ns() + (rank + 1) * 20 * MIN_SLICE;
+    l1_sleep_ns((rank + 1) * 20 * MIN_SLICE);
+    if (monotonic_ns() < deadline)
+        sleep_early = 1;
+    sleep_order[sleep_woken++] = rank;
+    return NULL;
+}
+
+START_TEST(sleep_order_test) {
+  // Sleepers wake up by deadline and never early. With every thread
+  // asleep, tsys waits in clock_nanosleep instead of spinning.
+  const int ranks[SLEEPERS] = { 2, 0, 4, 1, 3 };
+  sleep_woken = sleep_early = 0;
+  clean_up_scheduler();
+  initialize_scheduler(l1_round_robin_policy);
+  l1_tid tid;
+  for (int i = 0; i < SLEEPERS; i++)
+    l1_thread_create(&tid, thread_sleeper, (void*)(uintptr_t)ranks[i]);
+  struct timespec cpu_start, cpu_end;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+  const uint64_t start = monotonic_ns();
+  schedule();
+  const uint64_t wall = monotonic_ns() - start;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+  const uint64_t cpu = (cpu_end.tv_sec - cpu_start.tv_sec) * 1000000000ull
+                       + cpu_end.tv_nsec - cpu_start.tv_nsec;
+  ck_assert_msg(sleep_woken == SLEEPERS, "Every sleeper should wake up.");
+  ck_assert_msg(!sleep_early, "Sleepers should not wake up early.");
+  for (int i = 0; i < SLEEPERS; i++)
+    ck_assert_msg(sleep_order[i] == i, "Sleepers should wake up by deadline.");
+  ck_assert_msg(wall >= SLEEPERS * 20 * MIN_SLICE,
+                "schedule() should wait for the last sleeper.");
+  ck_assert_msg(cpu < wall / 4, "tsys should not spin while threads sleep.");
+}
+END_TEST
+
+int io_pipe[2];
+char io_received[8];
+unsigned io_spins = 0;
+int io_done = 0;
+
+void* thread_pipe_reader(void* arg) {
+    if (l1_read(io_pipe[0], io_received, sizeof(io_received) - 1) != 5)
+        return NULL;
+    io_done = 1;
+    return NULL;
+}
+
+void* thread_pipe_writer(void* arg) {
+    l1_sleep_ns(20 * MIN_SLICE);
+    l1_write(io_pipe[1], "hello", 5);
+    return NULL;
+}
+
+void* thread_pipe_spinner(void* arg) {
+    /* Runs as long as the reader waits */
+    while (!io_done) {
+        io_spins++;
+        yield(-1);
+    }
+    return NULL;
+}
+
+START_TEST(io_pipe_test) {
+  // A thread reading an empty pipe waits in IO_WAIT while the others run,
+  // and gets the data once a thread writes it.
+  memset(io_received, 0, sizeof(io_received));
+  io_spins = 0;
+  io_done = 0;
+  ck_assert_msg(pipe(io_pipe) == 0, "pipe() should succeed.");
+  clean_up_scheduler();
+  initialize_scheduler(l1_round_robin_policy);
+  l1_tid tid;
+  l1_thread_create(&tid, thread_pipe_reader, NULL);
+  l1_thread_create(&tid, thread_pipe_writer, NULL);
+  l1_thread_create(&tid, thread_pipe_spinner, NULL);
+  schedule();
+  close(io_pipe[0]);
+  close(io_pipe[1]);
+  ck_assert_msg(io_done && strcmp(io_received, "hello") == 0,
+                "The reader should get what was written.");
+  ck_assert_msg(io_spins > 100, "Other threads should run during the read.");
+}
+END_TEST
+
+#define ECHO_CLIENTS 64
+#define ECHO_ROUNDS 20
+
+int echo_listener;
+struct sockaddr_in echo_addr;
+int echo_ok = 0;
+
+void* thread_echo_server(void* arg) {
+    const int conn = (int)(intptr_t)arg;
+    char buf[64];
+    ssize_t n;
+    while ((n = l1_read(conn, buf, sizeof(buf))) > 0)
+        if (l1_write(conn, buf, n) != n)
+            break;
+    close(conn);
+    return NULL;
+}
+
+void* thread_echo_acceptor(void* arg) {
+    l1_tid tid;
+    for (int i = 0; i < ECHO_CLIENTS; i++) {
+        const int conn = l1_accept(echo_listener, NULL, NULL);
+        if (conn < 0)
+            return NULL;
+        l1_thread_create(&tid, thread_echo_server, (void*)(intptr_t)conn);
+    }
+    return NULL;
+}
+
+void* thread_echo_client(void* arg) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || l1_connect(fd, (struct sockaddr*)&echo_addr, sizeof(echo_addr)) != 0)
+        return NULL;
+    for (int i = 0; i < ECHO_ROUNDS; i++) {
+        char out[16], in[16];
+        const int len = snprintf(out, sizeof(out), "%d:%d", (int)(intptr_t)arg, i);
+        if (l1_write(fd, out, len) != len || l1_read(fd, in, sizeof(in)) != len
+            || memcmp(in, out, len) != 0) {
+            close(fd);
+            return NULL;
+        }
+    }
+    close(fd);
+    echo_ok++;
+    return NULL;
+}
+
+START_TEST(io_echo_test) {
+  // Clients and per-connection servers talk over loopback sockets, all in
+  // green threads, each message coming back as it was sent.
+  echo_ok = 0;
+  echo_listener = socket(AF_INET, SOCK_STREAM, 0);
+  memset(&echo_addr, 0, sizeof(echo_addr));
+  echo_addr.sin_family = AF_INET;
+  echo_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(echo_addr);
+  ck_assert_msg(echo_listener >= 0
+                && bind(echo_listener, (struct sockaddr*)&echo_addr, len) == 0
+                && listen(echo_listener, ECHO_CLIENTS) == 0
+                && getsockname(echo_listener, (struct sockaddr*)&echo_addr, &len) == 0,
+                "The listening socket should be set up.");
+  clean_up_scheduler();
+  initialize_scheduler(l1_round_robin_policy);
+  l1_tid tid;
+  l1_thread_create(&tid, thread_echo_acceptor, NULL);
+  for (intptr_t i = 0; i < ECHO_CLIENTS; i++)
+    l1_thread_create(&tid, thread_echo_client, (void*)i);
+  schedule();
+  close(echo_listener);
+  ck_assert_msg(echo_ok == ECHO_CLIENTS, "Every client should get its echoes.");
+}
+END_TEST
+
 int main(int argc, char **argv)
 {
     Suite* s = suite_create("Stack Library Tests");
@@ -36,6 +513,16 @@ int main(int argc, char **argv)
 
     /* TODO: Write your own tests */
     tcase_add_test(tc1, thread_executed_test);
+    tcase_add_test(tc1, thread_recycle_test);
+    tcase_add_test(tc1, idle_threads_rss_test);
+    tcase_add_test(tc1, direct_yield_test);
+    tcase_add_test(tc1, join_order_test);
+    tcase_add_test(tc1, extra_joiner_test);
+    tcase_add_test(tc1, preempt_latency_test);
+    tcase_add_test(tc1, preempt_mask_test);
+    tcase_add_test(tc1, sleep_order_test);
+    tcase_add_test(tc1, io_pipe_test);
+    tcase_add_test(tc1, io_echo_test);
 
     SRunner *sr = srunner_create(s); 
     srunner_run_all(sr, CK_VERBOSE); 
@@ -11,22 +11,57 @@
 #include "thread.h"
 #include "thread_info.h"
 #include "error.h"
+#include "preempt.h"
+
+unsigned l1_thread_pool_limit = THREAD_POOL_MAX;
+
+/* Info structs of dead threads kept for reuse */
+static l1_thread_info* thread_pool[THREAD_POOL_MAX];
+static unsigned thread_pool_count = 0;
+
+/** Helper function:
+ * Takes an info struct from the pool, or allocates one
+ */
+static l1_thread_info* thread_info_new(void) {
+  if (thread_pool_count > 0)
+    return thread_pool[--thread_pool_count];
+  return (l1_thread_info *) malloc(sizeof(l1_thread_info));
+}
+
+/** Helper function:
+ * Returns an info struct to the pool, or frees it
+ */
+static void thread_info_release(l1_thread_info* info) {
+  if (thread_pool_count < l1_thread_pool_limit
+      && thread_pool_count < THREAD_POOL_MAX) {
+    thread_pool[thread_pool_count++] = info;
+    return;
+  }
+  free(info);
+}
 
 void l1_start(void) {
   l1_thread_info* cur = get_scheduler()->current;
+  /* The first switch to a thread is made with preemption masked */
+  l1_preempt_depth = 1;
+  l1_preempt_enable();
   /* enter execution */
   void* ret = cur->thread_func(cur->thread_func_args); 
+  l1_preempt_disable();
   cur->retval = ret; 
   cur->state = ZOMBIE;
   /* Let the scheduler do the cleanup */
   yield(-1); 
 }
 
-l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *arg) {
+/** Helper function:
+ * Creates the thread, with preemption masked by l1_thread_create
+ */
+static l1_error thread_create(l1_tid *thread, void *(*start_routine)(void *), void *arg) {
   l1_tid new_tid = get_uniq_tid();
   /* TODO: Allocate l1_thread_info struct for new thread,
    * allocate stack for the thread. */
-  l1_thread_info *new_thread = (l1_thread_info *) malloc(sizeof(l1_thread_info));
+  l1_thread_info *new_thread = thread_info_new();
   if (new_thread == NULL) // Check if thread info struct allocated correctly
     return ERRNOMEM;
   memset(new_thread, 0, sizeof(l1_thread_info));
@@ -51,7 +86,7 @@ l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *
   /* Stack initialization */
   l1_stack *new_stack = l1_stack_new();
   if (new_stack == NULL) { // Check if new_stack allocated correctly
-    free(new_thread);
+    thread_info_release(new_thread);
     return ERRNOMEM;
   }
   // Stack alignment for System-V ABI compatibility
@@ -69,6 +104,12 @@ l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *
   l1_time_init(&new_thread->slice_start);
   l1_time_init(&new_thread->slice_end);
 
+  /* Index the thread by its ID for the scheduler's lookups */
+  if (thread_table_insert(&get_scheduler()->threads, new_thread) != SUCCESS) {
+    l1_thread_free(new_thread);
+    return ERRNOMEM;
+  }
+
   /* TODO: Add the new task for scheduling */
   add_to_scheduler(new_thread, RUNNABLE);
 
@@ -78,9 +119,17 @@ l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *
   return SUCCESS;
 }
 
+l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *arg) {
+  l1_preempt_disable();
+  const l1_error err = thread_create(thread, start_routine, arg);
+  l1_preempt_enable();
+  return err;
+}
+
 l1_error l1_thread_join(l1_tid target, void **retval) {
   /* TODO: Setup necessary metadata and block yourself */
   // Get current thread to set metadata and block it
+  l1_preempt_disable();
   l1_thread_info *current_thread = get_scheduler()->current;
   current_thread->state = BLOCKED;
   current_thread->joined_target = target;
@@ -96,6 +145,43 @@ l1_error l1_thread_join(l1_tid target, void **retval) {
   current_thread->joined_target = -1;
   current_thread->errno = SUCCESS;
   current_thread->join_recv = NULL;
+  l1_preempt_enable();
 
   return resulting_errno;
 }
+
+void l1_sleep_ns(l1_time ns) {
+  l1_time deadline;
+  l1_time_get(&deadline);
+  l1_time_add(&deadline, ns);
+  l1_sleep_until(deadline);
+}
+
+void l1_sleep_until(l1_time deadline) {
+  l1_preempt_disable();
+  l1_scheduler_info *sched = get_scheduler();
+  l1_thread_info *current_thread = sched->current;
+  l1_time now;
+  l1_time_get(&now);
+  if (l1_time_is_smaller(now, deadline)) {
+    /* The scheduler puts the thread aside until the timer wakes it up */
+    current_thread->state = SLEEPING;
+    timer_wheel_add(&sched->timers, &current_thread->sleep_timer, deadline);
+  }
+  yield(-1);
+  l1_preempt_enable();
+}
+
+void l1_thread_free(l1_thread_info* thread) {
+  thread_table_remove(&get_scheduler()->threads, thread);
+  /* Zombies give their stack back as soon as they exit */
+  if (thread->thread_stack != NULL)
+    l1_stack_free(thread->thread_stack);
+  thread_info_release(thread);
+}
+
+void l1_thread_pool_drain(void) {
+  while (thread_pool_count > 0)
+    free(thread_pool[--thread_pool_count]);
+  l1_stack_pool_drain();
+}
@@ -9,6 +9,11 @@
 #include "error.h"
 #include "thread_info.h"
 
+/* Info structs of dead threads are kept for reuse, up to
+ * `l1_thread_pool_limit` of them, as their stacks are in the stack pool */
+#define THREAD_POOL_MAX 256
+extern unsigned l1_thread_pool_limit;
+
 /* This is a function that calls a new thread's start_routine and stores the
  * return value in the function's info struct. This function is put on top
  * of the constructed stack for all new threads.
@@ -54,3 +59,31 @@ l1_error l1_thread_create(l1_tid *thread, void *(*start_routine)(void *), void *
  * @return  If successful, return SUCCESS. On error, it returns an error code.
  */
 l1_error l1_thread_join(l1_tid target, void **retval);
+
+/**
+ * @brief Sleeps for `ns` nanoseconds
+ *
+ * The thread leaves the CPU to the others until it is woken up, at most a
+ * timer wheel tick (65.5 us) after the delay, plus the time for the running
+ * thread to give up the CPU.
+ */
+void l1_sleep_ns(l1_time ns);
+
+/**
+ * @brief Sleeps until the l1_time_get() time `deadline`
+ *
+ * A deadline already passed only yields.
+ */
+void l1_sleep_until(l1_time deadline);
+
+/**
+ * @brief Releases a dead thread's info struct and stack
+ *
+ * Both go back to their pool if it has room, and are freed otherwise.
+ */
+void l1_thread_free(l1_thread_info* thread);
+
+/**
+ * @brief Frees every info struct and stack kept in the pools
+ */
+void l1_thread_pool_drain(void);
@@ -11,6 +11,8 @@
 #include "stack.h"
 #include "l1_time.h"
 #include "priority.h"
+#include "rbtree.h"
+#include "timer_wheel.h"
 
 typedef  void*(*thread_func_t)(void*) ;
 
@@ -20,6 +22,8 @@ typedef enum  {
   RUNNABLE,             /* The thread is not blocked on any other thread and 
                          * is ready to be run */
   BLOCKED,              /* Blocked on another process */
+  SLEEPING,             /* Sleeping until its timer expires */
+  IO_WAIT,              /* Waiting for a descriptor to be ready */
   ZOMBIE,               /* Zombie state waiting for one join */
   DEAD,                 /* Thread has been joined on and is ready to be collected */
   NUM_THREAD_STATES     
@@ -43,6 +47,12 @@ typedef struct l1_thread_info {
   struct  l1_thread_info* prev;   /** For thread scheduling */
   struct  l1_thread_info* next;   /** For thread scheduling */
   
+  /* Threads blocked joining this one, in the order they blocked, linked
+   * through their `join_next` */
+  struct  l1_thread_info* joiners_head; /** First joiner */
+  struct  l1_thread_info* joiners_tail; /** Last joiner */
+  struct  l1_thread_info* join_next;    /** Next joiner of the same target */
+
   l1_error errno;                 /** Per-thread errno */
   void* retval;                   /** Value returned by the thread */
   void** join_recv;               /** Pointer to put joined thread's return val */
@@ -53,4 +63,14 @@ typedef struct l1_thread_info {
   l1_time total_time;             /** Total execution time so far */
   l1_time slice_start;       /** Start time it was last scheduled */
   l1_time slice_end;         /**End time it was last descheduled */
+
+  /* Links and bookkeeping for the run queues of the policy, if it keeps
+   * its own */
+  struct  l1_thread_info* rq_prev; /** Previous thread in the run queue */
+  struct  l1_thread_info* rq_next; /** Next thread in the run queue */
+  uint64_t boost_mark;            /** MLFQ boosts done when it was queued */
+  l1_rb_node rq_node;             /** Node in the CFS run queue */
+  uint64_t vruntime;              /** Run time scaled by the CFS weight */
+
+  l1_timer sleep_timer;           /** Wakes the thread up when it sleeps */
 } l1_thread_info;
@@ -0,0 +1,105 @@
+/**
+ * @file thread_table.c
+ * @brief Implementation of the thread ID index.
+ */
+#include <stdlib.h>
+#include "thread_table.h"
+
+/** Helper function:
+ * Home slot of `tid`. Thread IDs are sequential, so a multiplicative hash
+ * spreads them over the whole table.
+ */
+static size_t table_slot(l1_thread_table* table, l1_tid tid) {
+  return ((uint32_t)tid * 2654435761u) & (table->capacity - 1);
+}
+
+/** Helper function:
+ * Puts a thread in the first free slot from its home slot
+ */
+static void table_place(l1_thread_table* table, l1_thread_info* thread) {
+  size_t i = table_slot(table, thread->id);
+  while (table->slots[i] != NULL)
+    i = (i + 1) & (table->capacity - 1);
+  table->slots[i] = thread;
+}
+
+/** Helper function:
+ * Rehashes the table into `capacity` slots
+ */
+static l1_error table_resize(l1_thread_table* table, size_t capacity) {
+  l1_thread_info** old = table->slots;
+  const size_t old_capacity = table->capacity;
+
+  table->slots = calloc(capacity, sizeof(l1_thread_info*));
+  if (table->slots == NULL) {
+    table->slots = old;
+    return ERRNOMEM;
+  }
+  table->capacity = capacity;
+  for (size_t i = 0; i < old_capacity; i++)
+    if (old[i] != NULL)
+      table_place(table, old[i]);
+  free(old);
+  return SUCCESS;
+}
+
+l1_error thread_table_insert(l1_thread_table* table, l1_thread_info* thread) {
+  if (table == NULL || thread == NULL) {
+    return ERRINVAL;
+  }
+  if (2 * (table->size + 1) > table->capacity) {
+    const size_t capacity = table->capacity ? 2 * table->capacity
+                                            : THREAD_TABLE_MIN_CAPACITY;
+    if (table_resize(table, capacity) != SUCCESS)
+      return ERRNOMEM;
+  }
+  table_place(table, thread);
+  table->size++;
+  return SUCCESS;
+}
+
+l1_thread_info* thread_table_find(l1_thread_table* table, l1_tid tid) {
+  if (table == NULL || table->size == 0) {
+    return NULL;
+  }
+  for (size_t i = table_slot(table, tid); table->slots[i] != NULL;
+       i = (i + 1) & (table->capacity - 1)) {
+    if (table->slots[i]->id == tid) {
+      return table->slots[i];
+    }
+  }
+  return NULL;
+}
+
+void thread_table_remove(l1_thread_table* table, l1_thread_info* thread) {
+  if (table == NULL || thread == NULL || table->size == 0) {
+    return;
+  }
+  const size_t mask = table->capacity - 1;
+  size_t hole = table_slot(table, thread->id);
+  while (table->slots[hole] != thread) {
+    if (table->slots[hole] == NULL)
+      return;
+    hole = (hole + 1) & mask;
+  }
+
+  /* Shift back every following entry that may not sit past the hole */
+  for (size_t i = (hole + 1) & mask; table->slots[i] != NULL; i = (i + 1) & mask) {
+    const size_t home = table_slot(table, table->slots[i]->id);
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      table->slots[hole] = table->slots[i];
+      hole = i;
+    }
+  }
+  table->slots[hole] = NULL;
+  table->size--;
+}
+
+void thread_table_clear(l1_thread_table* table) {
+  if (table == NULL) {
+    return;
+  }
+  free(table->slots);
+  table->slots = NULL;
+  table->capacity = table->size = 0;
+}
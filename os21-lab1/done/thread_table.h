@@ -0,0 +1,50 @@
+/**
+ * @file thread_table.h
+ * @brief Header file for the thread ID index
+ */
+
+#pragma once
+#include <stddef.h>
+#include "error.h"
+#include "thread_info.h"
+
+/* Initial number of slots, a power of two */
+#define THREAD_TABLE_MIN_CAPACITY 64
+
+/**
+ * @brief An open-addressing hash table of threads, keyed by thread ID.
+ *
+ * Slots are probed linearly from the slot of the ID. Removals shift the
+ * following entries back instead of leaving tombstones, so lookups never
+ * probe past the first empty slot. The table doubles when half full.
+ */
+typedef struct l1_thread_table {
+  size_t capacity;          /** Number of slots, a power of two */
+  size_t size;              /** Number of threads in the table */
+  l1_thread_info **slots;   /** The slots, NULL when empty */
+} l1_thread_table;
+
+/**
+ * @brief Adds a thread to the table, under its ID
+ * @warning The function does not check that the ID is not already present.
+ *
+ * @return SUCCESS, or ERRNOMEM if the table could not grow.
+ */
+l1_error thread_table_insert(l1_thread_table* table, l1_thread_info* thread);
+
+/**
+ * @brief Removes a thread from the table. Does nothing if it is absent.
+ */
+void thread_table_remove(l1_thread_table* table, l1_thread_info* thread);
+
+/**
+ * @brief Finds the thread with ID `tid`
+ *
+ * @return l1_thread_info* thread, or NULL if there is none
+ */
+l1_thread_info* thread_table_find(l1_thread_table* table, l1_tid tid);
+
+/**
+ * @brief Frees the slots of the table and empties it
+ */
+void thread_table_clear(l1_thread_table* table);
@@ -0,0 +1,153 @@
+/**
+ * @file timer_wheel.c
+ * @brief Implementation of the hierarchical timer wheel.
+ */
+#include "timer_wheel.h"
+
+#define SLOT_MASK ((uint64_t)TIMER_SLOTS - 1)
+
+/** Helper function:
+ * Number of ticks covered by a slot of `level`
+ */
+static inline uint64_t level_span(int level) {
+  return (uint64_t)1 << (level * TIMER_SLOT_BITS);
+}
+
+/** Helper function:
+ * Links a timer in the slot of the wheel where its deadline falls
+ */
+static void wheel_link(l1_timer_wheel *wheel, l1_timer *timer) {
+  /* Rounded up, so that the timer does not expire before its deadline */
+  uint64_t expires = (timer->deadline + ((l1_time)1 << TIMER_TICK_SHIFT) - 1)
+                     >> TIMER_TICK_SHIFT;
+  if (expires < wheel->tick)
+    expires = wheel->tick;
+  const uint64_t span = level_span(TIMER_LEVELS) - 1;
+  if (expires - wheel->tick > span)
+    expires = wheel->tick + span;
+
+  int level = 0;
+  while (expires - wheel->tick >= level_span(level + 1))
+    level++;
+  const int slot = (expires >> (level * TIMER_SLOT_BITS)) & SLOT_MASK;
+
+  timer->level = level;
+  timer->slot = slot;
+  timer->prev = NULL;
+  timer->next = wheel->slots[level][slot];
+  if (timer->next != NULL)
+    timer->next->prev = timer;
+  wheel->slots[level][slot] = timer;
+  wheel->pending[level] |= (uint64_t)1 << slot;
+}
+
+/** Helper function:
+ * Empties a slot, returning its timers linked through `next`
+ */
+static l1_timer *wheel_take_slot(l1_timer_wheel *wheel, int level, int slot) {
+  l1_timer *head = wheel->slots[level][slot];
+  wheel->slots[level][slot] = NULL;
+  wheel->pending[level] &= ~((uint64_t)1 << slot);
+  return head;
+}
+
+/** Helper function:
+ * Spreads the slot of `level` starting at the current tick over the levels
+ * below. Returns the index of that slot.
+ */
+static int wheel_cascade(l1_timer_wheel *wheel, int level) {
+  const int slot = (wheel->tick >> (level * TIMER_SLOT_BITS)) & SLOT_MASK;
+  l1_timer *timer = wheel_take_slot(wheel, level, slot);
+  while (timer != NULL) {
+    l1_timer *next = timer->next;
+    wheel_link(wheel, timer);
+    timer = next;
+  }
+  return slot;
+}
+
+void timer_wheel_add(l1_timer_wheel *wheel, l1_timer *timer, l1_time deadline) {
+  timer->deadline = deadline;
+  wheel_link(wheel, timer);
+  wheel->count++;
+}
+
+void timer_wheel_del(l1_timer_wheel *wheel, l1_timer *timer) {
+  if (timer->prev != NULL)
+    timer->prev->next = timer->next;
+  else
+    wheel->slots[timer->level][timer->slot] = timer->next;
+  if (timer->next != NULL)
+    timer->next->prev = timer->prev;
+  if (wheel->slots[timer->level][timer->slot] == NULL)
+    wheel->pending[timer->level] &= ~((uint64_t)1 << timer->slot);
+  timer->prev = timer->next = NULL;
+  wheel->count--;
+}
+
+l1_timer *timer_wheel_expire(l1_timer_wheel *wheel, l1_time now) {
+  const uint64_t target = now >> TIMER_TICK_SHIFT;
+  l1_timer *expired = NULL;
+
+  while (wheel->tick <= target && wheel->count > 0) {
+    const int slot = wheel->tick & SLOT_MASK;
+    /* Spread the upper levels when level 0 wraps around, each level when the
+     * one below wraps around too */
+    if (slot == 0) {
+      for (int level = 1; level < TIMER_LEVELS; level++) {
+        if (wheel_cascade(wheel, level) != 0)
+          break;
+      }
+    }
+
+    l1_timer *timer = wheel_take_slot(wheel, 0, slot);
+    while (timer != NULL) {
+      l1_timer *next = timer->next;
+      timer->prev = NULL;
+      timer->next = expired;
+      expired = timer;
+      wheel->count--;
+      timer = next;
+    }
+
+    /* Skip the empty slots up to the next wrap around, but not past `now`:
+     * timers added later may be due right after it */
+    const uint64_t ahead = (wheel->pending[0] >> slot) & ~(uint64_t)1;
+    uint64_t tick = (ahead != 0) ? wheel->tick + __builtin_ctzll(ahead)
+                                 : (wheel->tick | SLOT_MASK) + 1;
+    wheel->tick = (tick <= target) ? tick : target + 1;
+  }
+  /* An empty wheel just follows the time */
+  if (wheel->tick <= target)
+    wheel->tick = target + 1;
+  return expired;
+}
+
+int timer_wheel_next(const l1_timer_wheel *wheel, l1_time *when) {
+  if (wheel->count == 0)
+    return 0;
+
+  uint64_t tick;
+  const int slot = wheel->tick & SLOT_MASK;
+  const uint64_t ahead = wheel->pending[0] >> slot;
+  int upper = 0;
+  for (int level = 1; level < TIMER_LEVELS; level++)
+    upper |= (wheel->pending[level] != 0);
+  if (slot == 0 && upper) {
+    /* Upper levels have yet to be spread for this round */
+    tick = wheel->tick;
+  } else if (ahead != 0) {
+    /* The first timer due in this round of level 0 */
+    tick = wheel->tick + __builtin_ctzll(ahead);
+  } else {
+    /* Timers in level 0 are in its next round, and timers in the lowest
+     * non-empty level above come down when the level below it wraps */
+    int level = 0;
+    while (level < TIMER_LEVELS - 1 && wheel->pending[level] == 0)
+      level++;
+    const uint64_t span = level_span(level > 0 ? level : 1);
+    tick = (wheel->tick + span - 1) & ~(span - 1);
+  }
+  *when = (l1_time)tick << TIMER_TICK_SHIFT;
+  return 1;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file timer_wheel.h
+ * @brief Header file for a hierarchical timer wheel
+ *
+ * Time is cut in ticks of 2^TIMER_TICK_SHIFT ns. The wheel has
+ * TIMER_LEVELS levels of TIMER_SLOTS slots: level 0 holds the timers due in
+ * the next TIMER_SLOTS ticks, one slot per tick, and each level above covers
+ * TIMER_SLOTS times the span of the one below. Whenever level 0 wraps
+ * around, the next slot of level 1 is spread over level 0, and so on up the
+ * levels. Adding and removing a timer are O(1); expiring costs one step per
+ * elapsed tick, skipping the ticks when level 0 is empty.
+ *
+ * The wheel only learns the time from timer_wheel_expire(), which should be
+ * called regularly even when the wheel is empty: timers are placed relative
+ * to the last call.
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "l1_time.h"
+
+#define TIMER_TICK_SHIFT 16             /* Ticks of 65.5 us */
+#define TIMER_SLOT_BITS 6
+#define TIMER_SLOTS (1 << TIMER_SLOT_BITS)
+#define TIMER_LEVELS 4                  /* Spanning 2^24 ticks, 18 minutes */
+
+/**
+ * @brief A timer, to embed in the structure it wakes up.
+ */
+typedef struct l1_timer {
+  struct l1_timer *prev;
+  struct l1_timer *next;  /** Next timer of the slot, or of the expired list */
+  l1_time deadline;       /** Time at which the timer expires */
+  uint8_t level;          /** Level and slot the timer is in */
+  uint8_t slot;
+} l1_timer;
+
+typedef struct {
+  l1_timer *slots[TIMER_LEVELS][TIMER_SLOTS];
+  uint64_t pending[TIMER_LEVELS];   /** Bit i set if slot i has timers */
+  uint64_t tick;                    /** First tick not expired yet */
+  size_t count;                     /** Number of timers in the wheel */
+} l1_timer_wheel;
+
+/* Gets the structure of type `type` embedding `timer` as `member` */
+#define timer_entry(timer, type, member) \
+  ((type *)((char *)(timer) - offsetof(type, member)))
+
+/**
+ * @brief Adds a timer expiring at `deadline`.
+ *
+ * A timer is never expired before its deadline, and at most one tick after
+ * it. Deadlines already passed expire on the next tick. Deadlines beyond the
+ * span of the wheel wait at its top level until they come within it.
+ */
+void timer_wheel_add(l1_timer_wheel *wheel, l1_timer *timer, l1_time deadline);
+
+/**
+ * @brief Removes a pending timer.
+ * @warning The function does not check that timer is in wheel.
+ */
+void timer_wheel_del(l1_timer_wheel *wheel, l1_timer *timer);
+
+/**
+ * @brief Expires the timers due at time `now`.
+ *
+ * @return The expired timers, linked through `next` in no particular order,
+ *         or NULL
+ */
+l1_timer *timer_wheel_expire(l1_timer_wheel *wheel, l1_time now);
+
+/**
+ * @brief Puts in `when` a time by which timer_wheel_expire() must be called
+ * next: the deadline of the earliest timer, or earlier if the wheel has to
+ * spread a slot of an upper level first.
+ *
+ * @return 0 if the wheel is empty, 1 otherwise
+ */
+int timer_wheel_next(const l1_timer_wheel *wheel, l1_time *when);